@@ -3,6 +3,10 @@ find_program(AVR_SIZE avr-size)
 find_program(AVR_OBJCOPY avr-objcopy)
 find_program(AVR_OBJDUMP avr-objdump)
 find_program(AVRDUDE avrdude)
+find_program(AVR_GCC_AR avr-gcc-ar)
+find_program(AVR_GCC_RANLIB avr-gcc-ranlib)
+find_program(AVR_GCC_NM avr-gcc-nm)
+find_program(PYTHON3 python3)
 
 set(CMAKE_SYSTEM_NAME Generic)
 set(CMAKE_SYSTEM_PROCESSOR avr)
@@ -11,27 +15,80 @@ set(CMAKE_C_COMPILER ${AVR_CC})
 set(MCU atmega328p)
 set(F_CPU 8000000)
 set(BAUD 9600)
+set(I2C_SCL_HZ 100000)
+set(TICK_US 1000)
 #set(AVR_PROGRAMMER usbtiny)
 set(AVR_PROGRAMMER avrisp)
 set(AVR_PROGRAMMER_ARGS -b 19200)
 set(AVR_PROGRAMMER_PORT -P /dev/ttyACM0)
 
 
-set(CMAKE_C_FLAGS "-mmcu=${MCU} -DF_CPU=${F_CPU}UL -DBAUD=${BAUD}")
-set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -Wl,-Map,mapfile.map")
+set(CMAKE_C_FLAGS "-mmcu=${MCU} -DF_CPU=${F_CPU}UL -DBAUD=${BAUD} -DI2C_SCL_HZ=${I2C_SCL_HZ}UL")
+set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -DTICK_US=${TICK_US}UL")
 set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -Os -Wall -Wstrict-prototypes -g -ggdb")
 set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -ffunction-sections -fdata-sections -Wl,--gc-sections -Wl,--relax")
 set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -std=gnu99")
 
+option(BITLOOM_PROFILE "Build with the task and interrupt CPU time profiler" OFF)
+if(BITLOOM_PROFILE)
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -DBITLOOM_PROFILE")
+endif()
+
+option(BITLOOM_TRACE "Build with the GPIO trace hooks" OFF)
+if(BITLOOM_TRACE)
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -DBITLOOM_TRACE")
+endif()
+
+option(BITLOOM_NAKED_ISR "Build the tick and UART receive interrupts in hand written assembler" OFF)
+if(BITLOOM_NAKED_ISR)
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -DBITLOOM_NAKED_ISR")
+endif()
+
+# The ATtiny devices have no USART or TWI module. The HAL modules are then
+# built with a software UART and a USI based I2C master instead.
+if(MCU MATCHES "^attiny")
+    set(BITLOOM_ATTINY ON)
+else()
+    set(BITLOOM_ATTINY OFF)
+endif()
+
+option(BITLOOM_UART_WAKE "Wake up from power down on UART receive (uses the PCINT2 interrupt)" OFF)
+if(BITLOOM_UART_WAKE AND BITLOOM_ATTINY)
+    message(FATAL_ERROR "Wake on UART receive requires the USART")
+elseif(BITLOOM_UART_WAKE)
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -DBITLOOM_UART_WAKE")
+endif()
+
+# The LTO objects in the HAL libraries must be archived with the gcc wrappers
+# of ar, ranlib and nm, which load the LTO plugin
+option(BITLOOM_LTO "Build with link time optimization" OFF)
+if(BITLOOM_LTO)
+    set(CMAKE_C_FLAGS "${CMAKE_C_FLAGS} -flto")
+    set(CMAKE_AR ${AVR_GCC_AR} CACHE FILEPATH "Archiver" FORCE)
+    set(CMAKE_RANLIB ${AVR_GCC_RANLIB} CACHE FILEPATH "Ranlib" FORCE)
+    set(CMAKE_NM ${AVR_GCC_NM} CACHE FILEPATH "Nm" FORCE)
+endif()
+
+set(BITLOOM_SPEED_MODULES "" CACHE STRING "HAL modules built with -O2 instead of -Os, e.g. timer;uart_hal")
+
 set(TOOLCHAIN_DIR ${CMAKE_CURRENT_LIST_DIR})
 set(BITLOOM_HAL ${TOOLCHAIN_DIR}/avr_hal )
 
 # Print configuration
 message( STATUS "Toolchain CMakefile directory: ${TOOLCHAIN_DIR}")
 message( STATUS "AVR MCU: ${MCU}" )
+message( STATUS "ATtiny HAL variant: ${BITLOOM_ATTINY}" )
 message( STATUS "CPU Frequency: ${F_CPU} Hz" )
 message( STATUS "BAUD Rate: ${BAUD}" )
+message( STATUS "I2C SCL Frequency: ${I2C_SCL_HZ} Hz" )
+message( STATUS "Tick period: ${TICK_US} us" )
 message( STATUS "AVR Programmer: ${AVR_PROGRAMMER}" )
+message( STATUS "Profiler: ${BITLOOM_PROFILE}" )
+message( STATUS "GPIO trace: ${BITLOOM_TRACE}" )
+message( STATUS "Naked interrupts: ${BITLOOM_NAKED_ISR}" )
+message( STATUS "Wake on UART receive: ${BITLOOM_UART_WAKE}" )
+message( STATUS "Link time optimization: ${BITLOOM_LTO}" )
+message( STATUS "HAL modules optimized for speed: ${BITLOOM_SPEED_MODULES}" )
 
 # Cross-compile version of the add_executable command
 function(cc_add_executable NAME)
@@ -48,6 +105,10 @@ function(cc_add_executable NAME)
     add_executable(${elf_file} EXCLUDE_FROM_ALL ${ARGN})
     add_custom_target(${NAME} ALL DEPENDS ${hex_file})
 
+    # Map file, used by the footprint target. Appended to the link flags of
+    # the project (target_link_options needs CMake 3.13).
+    set_property(TARGET ${elf_file} APPEND_STRING PROPERTY LINK_FLAGS " -Wl,-Map,${map_file}")
+
     # Save the original name to be used in the cc_target_include_directories
     # and cc_target_link_libraries function calls
     set_target_properties( ${NAME} PROPERTIES OUTPUT_NAME "${elf_file}" )
@@ -86,6 +147,24 @@ function(cc_add_executable NAME)
             VERBATIM
     )
 
+    # Footprint per module and symbol, compared with ${NAME}-footprint.json
+    # in the source directory. Run footprint_baseline to update it.
+    set(footprint_baseline ${CMAKE_CURRENT_SOURCE_DIR}/${NAME}-footprint.json)
+    add_custom_target(
+            footprint
+            COMMAND ${PYTHON3} ${TOOLCHAIN_DIR}/tools/footprint.py ${map_file} --baseline ${footprint_baseline}
+            DEPENDS ${elf_file}
+            COMMENT "Footprint of ${elf_file} per module and symbol"
+            VERBATIM
+    )
+    add_custom_target(
+            footprint_baseline
+            COMMAND ${PYTHON3} ${TOOLCHAIN_DIR}/tools/footprint.py ${map_file} --baseline ${footprint_baseline} --update
+            DEPENDS ${elf_file}
+            COMMENT "Writing the footprint of ${elf_file} to ${footprint_baseline}"
+            VERBATIM
+    )
+
 endfunction(cc_add_executable)
 
 
@@ -102,3 +181,12 @@ function(cc_target_link_libraries NAME)
     target_link_libraries(${TARGET} ${ARGN})
 endfunction(cc_target_link_libraries)
 
+
+# Build settings of a HAL module library, called from the CMakeLists of each
+# module. The modules in BITLOOM_SPEED_MODULES are built with -O2, which
+# overrides the -Os in CMAKE_C_FLAGS.
+function(bitloom_module_options NAME)
+    if(NAME IN_LIST BITLOOM_SPEED_MODULES)
+        target_compile_options(${NAME} PRIVATE -O2)
+    endif()
+endfunction(bitloom_module_options)
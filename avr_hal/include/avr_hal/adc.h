@@ -0,0 +1,78 @@
+/*
+ * ADC module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_ADC_H
+#define AVR_HAL_ADC_H
+
+#include <stdint.h>
+
+// The size of the sample ring, must be a power of two (at most 128)
+#ifndef ADC_RING_SIZE
+#define ADC_RING_SIZE 32
+#endif
+
+/*
+ * A sample holds the channel in the upper four bits and the 10-bit
+ * conversion result in the lower bits.
+ */
+#define ADC_SAMPLE_CHANNEL(sample) ((uint8_t)((sample) >> 12))
+#define ADC_SAMPLE_VALUE(sample) ((uint16_t)((sample) & 0x03ff))
+
+// The values are the REFS1:0 bits in ADMUX (page 217 in the datasheet)
+typedef enum
+{
+    adc_reference_aref = 0,
+    adc_reference_avcc = 1,
+    adc_reference_internal = 3
+} adc_reference_t;
+
+// The values are the ADTS2:0 bits in ADCSRB (page 221)
+typedef enum
+{
+    adc_trigger_timer0_compare_a = 3,
+    adc_trigger_timer1_compare_b = 5
+} adc_trigger_t;
+
+/*
+ * Enable the ADC. The ADC clock prescaler is calculated from F_CPU to give
+ * at most 200 kHz, which is needed for the full 10-bit resolution.
+ */
+void adc_init(adc_reference_t reference);
+
+/*
+ * Blocking single conversion (about 13 ADC clock cycles). Must not be used
+ * while sampling is running.
+ */
+uint16_t adc_read(uint8_t channel);
+
+/*
+ * Start sampling the channels in the bit mask (bit 0 is channel 0). A
+ * conversion is started on each trigger event and the channels are sampled
+ * in turn, lowest channel first. The samples are written to the ring.
+ *
+ * With the Timer 0 trigger a conversion is made every tick. Timer 1 must be
+ * set up by the application (e.g. with the timer_pwm module) to use the
+ * Timer 1 trigger.
+ */
+void adc_start(uint8_t channels, adc_trigger_t trigger);
+void adc_stop(void);
+
+/*
+ * Move up to max samples from the ring to samples, oldest first. Returns the
+ * number of samples read.
+ */
+uint8_t adc_read_block(uint16_t *samples, uint8_t max);
+
+/*
+ * Returns the number of samples dropped since the ring was full.
+ */
+uint16_t adc_get_overruns(void);
+
+#endif // AVR_HAL_ADC_H
@@ -0,0 +1,110 @@
+/*
+ * EEPROM module for AVR with an interrupt driven write queue.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_EEPROM_H
+#define AVR_HAL_EEPROM_H
+
+#include <stdint.h>
+
+/*
+ * A write is described by a caller owned descriptor, in the same way as the
+ * I2C transactions in avr_hal/i2c_async.h. The length bytes in data are
+ * written to the EEPROM starting at address, one byte per EEPROM ready
+ * interrupt. Bytes that already have the new value are skipped.
+ *
+ * The descriptor and the data must stay valid until the write has
+ * completed. The callback, if set, is called from the interrupt when all
+ * bytes have been written. It may submit a new write.
+ */
+typedef struct eeprom_write eeprom_write_t;
+typedef void (*eeprom_callback_t)(eeprom_write_t *write);
+
+struct eeprom_write
+{
+    uint16_t address;
+    const uint8_t *data;
+    uint8_t length;
+    eeprom_callback_t callback;
+
+    // Set by the module
+    volatile uint8_t pending;
+    eeprom_write_t *next;
+};
+
+/*
+ * Queue a write and return immediately. The writes are done in the order
+ * they were submitted.
+ */
+void eeprom_write_submit(eeprom_write_t *write);
+
+/*
+ * Returns non-zero as long as there are queued or ongoing writes.
+ */
+uint8_t eeprom_busy(void);
+
+/*
+ * Read length bytes starting at address. Bytes that are covered by queued
+ * writes are read from the data of the last of those writes, i.e. the
+ * result is what the EEPROM will contain when the queue is done.
+ *
+ * The EEPROM cannot be read while a byte is written, so the function may
+ * wait for up to one byte write (3.4 ms) per byte read from the EEPROM.
+ */
+void eeprom_read(uint16_t address, uint8_t *buffer, uint8_t length);
+
+/*
+ * Wear leveling for records that are written often, e.g. counters, as
+ * described in the application note AVR101. The record is written to the
+ * next of slots slots each time, which multiplies the endurance by slots.
+ *
+ * The EEPROM area starts at address and holds slots records of size bytes
+ * followed by a status buffer of slots bytes, in total slots * (size + 1)
+ * bytes. The status byte of a slot is one more than the status of the
+ * previous slot, and the current slot is found where the sequence breaks.
+ * The status byte is written after the record, so a reset during the write
+ * leaves the previous record as the current one.
+ *
+ * An erased area gives a record with all bytes 0xff.
+ */
+typedef struct
+{
+    uint16_t address;
+    uint8_t slots;
+    uint8_t size;
+    uint8_t index;
+    uint8_t status;
+    eeprom_write_t record_write;
+    eeprom_write_t status_write;
+} eeprom_wl_t;
+
+/*
+ * Set up the wear leveling area and find the current slot. The status buffer
+ * is read with eeprom_read.
+ */
+void eeprom_wl_init(eeprom_wl_t *wl, uint16_t address, uint8_t slots, uint8_t size);
+
+/*
+ * Read the current record, including a write that hasn't completed.
+ */
+void eeprom_wl_read(eeprom_wl_t *wl, uint8_t *record);
+
+/*
+ * Queue a write of the record to the next slot. The record must stay valid
+ * until the write has completed. Returns 0 (and nothing is written) if the
+ * previous write of the area hasn't completed yet, otherwise 1.
+ */
+uint8_t eeprom_wl_write(eeprom_wl_t *wl, const uint8_t *record);
+
+/*
+ * Returns non-zero while a write of the area is ongoing.
+ */
+uint8_t eeprom_wl_busy(const eeprom_wl_t *wl);
+
+#endif // AVR_HAL_EEPROM_H
@@ -0,0 +1,46 @@
+/*
+ * AVR specific extensions to the I2C module.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_I2C_H
+#define AVR_HAL_I2C_H
+
+#include <stdint.h>
+#include "hal/i2c.h"
+
+/*
+ * Result returned when the TWI hardware doesn't complete an operation within
+ * I2C_TIMEOUT_TICKS ticks. The enumeration in hal/i2c.h has no value for
+ * this, so a value outside of the defined range is used.
+ */
+#define i2c_timeout ((i2c_result_t) 0x40)
+
+/*
+ * Release a bus that is held by a slave. The TWI module is disabled and SCL
+ * is clocked until the slave releases SDA (at most 9 pulses) and a STOP
+ * condition is sent. Finally the TWI module is enabled again.
+ *
+ * This is done automatically when an operation times out, but it can also
+ * be called at startup since a slave may hold the bus after a reset of the
+ * MCU in the middle of a transfer.
+ */
+void i2c_bus_clear (void);
+
+/*
+ * Read length bytes from the register reg in the slave with the 7-bit
+ * address. The register pointer is written, followed by a repeated start and
+ * a read of all bytes in one transaction. All bytes but the last are ACKed.
+ *
+ * Returns i2c_ok when all bytes have been read. The bus is released with a
+ * STOP condition in all cases except when the arbitration was lost.
+ */
+i2c_result_t i2c_read_burst (uint8_t address, uint8_t reg,
+                             uint8_t *buffer, uint8_t length);
+
+#endif // AVR_HAL_I2C_H
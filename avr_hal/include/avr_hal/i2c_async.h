@@ -0,0 +1,62 @@
+/*
+ * Interrupt driven I2C master engine for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_I2C_ASYNC_H
+#define AVR_HAL_I2C_ASYNC_H
+
+#include <stdint.h>
+#include "hal/i2c.h"
+
+/*
+ * A transaction is described by a caller owned descriptor. The engine first
+ * writes write_length bytes from write_buffer to the slave and then, after a
+ * repeated start, reads read_length bytes into read_buffer. Either part may
+ * be empty. A transaction with both lengths set to zero only addresses the
+ * slave, which can be used to probe for devices on the bus.
+ *
+ * The descriptor (and the buffers) must stay valid until the transaction has
+ * completed. The callback, if set, is called from the TWI interrupt when the
+ * transaction is finished. It may submit a new transaction.
+ */
+typedef struct i2c_transaction i2c_transaction_t;
+typedef void (*i2c_async_callback_t)(i2c_transaction_t *transaction);
+
+struct i2c_transaction
+{
+    uint8_t address;                // 7-bit slave address
+    const uint8_t *write_buffer;
+    uint8_t write_length;
+    uint8_t *read_buffer;
+    uint8_t read_length;
+    i2c_async_callback_t callback;
+
+    // Set by the engine
+    volatile uint8_t pending;
+    volatile i2c_result_t result;
+    i2c_transaction_t *next;
+};
+
+/*
+ * Queue a transaction and return immediately. If the bus is idle the
+ * transaction is started at once, otherwise it is started when the ones
+ * queued before it have completed. i2c_init must have been called first.
+ *
+ * The result of the transaction is one of i2c_ok, i2c_nack_received,
+ * i2c_arbitration_lost or i2c_operation_error.
+ */
+void i2c_async_submit (i2c_transaction_t *transaction);
+
+/*
+ * Returns non-zero as long as there are queued or ongoing transactions. The
+ * blocking functions in hal/i2c.h must not be used while the engine is busy.
+ */
+uint8_t i2c_async_busy (void);
+
+#endif // AVR_HAL_I2C_ASYNC_H
@@ -0,0 +1,179 @@
+/*
+ * AVR specific extensions to the PIN digital IO module.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_PIN_DIGITAL_IO_H
+#define AVR_HAL_PIN_DIGITAL_IO_H
+
+#include <stdint.h>
+#include <avr/io.h>
+
+/*
+ * A pin id holds the port in the high byte and the bit in the low byte. Port
+ * 0 is the LED_PORT in config/port_config.h, so plain bit numbers work as
+ * before.
+ */
+#define PIN_PORT_LED 0
+#define PIN_PORT_B 1
+#define PIN_PORT_C 2
+#define PIN_PORT_D 3
+
+#define PIN_ID(port, bit) ((uint16_t)(((port) << 8) | (bit)))
+#define PIN_ID_PORT(pin_id) ((uint8_t)((pin_id) >> 8))
+#define PIN_ID_BIT(pin_id) ((uint8_t)((pin_id) & 0x07))
+
+typedef enum
+{
+    pin_digital_io_input,
+    pin_digital_io_input_pullup,
+    pin_digital_io_output
+} pin_digital_io_mode_t;
+
+void pin_digital_io_write_high(uint16_t pin_id);
+void pin_digital_io_write_low(uint16_t pin_id);
+
+/*
+ * Set the pin as input (with or without the internal pull-up) or output.
+ */
+void pin_digital_io_set_mode(uint16_t pin_id, pin_digital_io_mode_t mode);
+
+/*
+ * Returns 1 if the pin is high and 0 if it is low.
+ */
+uint8_t pin_digital_io_read(uint16_t pin_id);
+
+/*
+ * Toggle an output pin. The write-1-to-toggle feature of the PINx register is
+ * used, so no read-modify-write is needed.
+ */
+void pin_digital_io_toggle(uint16_t pin_id);
+
+/*
+ * Set the pins in mask of the port (PIN_PORT_x) to the corresponding bits in
+ * value with a single store. The pins that differ are toggled through PINx,
+ * so pins outside of the mask are never written.
+ */
+void pin_digital_io_write_port_masked(uint8_t port, uint8_t mask, uint8_t value);
+
+/*
+ * Inline versions of the write functions. When the pin id is a constant the
+ * write compiles to a single sbi/cbi instruction. Otherwise (or for the LED
+ * port) the runtime functions are called.
+ */
+static inline __attribute__((always_inline))
+void pin_digital_io_fast_high(uint16_t pin_id)
+{
+    if (__builtin_constant_p(pin_id))
+    {
+        switch (PIN_ID_PORT(pin_id))
+        {
+#if defined(PORTB)
+            case PIN_PORT_B: PORTB |= (1 << PIN_ID_BIT(pin_id)); return;
+#endif
+#if defined(PORTC)
+            case PIN_PORT_C: PORTC |= (1 << PIN_ID_BIT(pin_id)); return;
+#endif
+#if defined(PORTD)
+            case PIN_PORT_D: PORTD |= (1 << PIN_ID_BIT(pin_id)); return;
+#endif
+            default: break;
+        }
+    }
+    pin_digital_io_write_high(pin_id);
+}
+
+static inline __attribute__((always_inline))
+void pin_digital_io_fast_low(uint16_t pin_id)
+{
+    if (__builtin_constant_p(pin_id))
+    {
+        switch (PIN_ID_PORT(pin_id))
+        {
+#if defined(PORTB)
+            case PIN_PORT_B: PORTB &= ~(1 << PIN_ID_BIT(pin_id)); return;
+#endif
+#if defined(PORTC)
+            case PIN_PORT_C: PORTC &= ~(1 << PIN_ID_BIT(pin_id)); return;
+#endif
+#if defined(PORTD)
+            case PIN_PORT_D: PORTD &= ~(1 << PIN_ID_BIT(pin_id)); return;
+#endif
+            default: break;
+        }
+    }
+    pin_digital_io_write_low(pin_id);
+}
+
+static inline __attribute__((always_inline))
+void pin_digital_io_fast_toggle(uint16_t pin_id)
+{
+    if (__builtin_constant_p(pin_id))
+    {
+        switch (PIN_ID_PORT(pin_id))
+        {
+#if defined(PINB)
+            case PIN_PORT_B: PINB = (1 << PIN_ID_BIT(pin_id)); return;
+#endif
+#if defined(PINC)
+            case PIN_PORT_C: PINC = (1 << PIN_ID_BIT(pin_id)); return;
+#endif
+#if defined(PIND)
+            case PIN_PORT_D: PIND = (1 << PIN_ID_BIT(pin_id)); return;
+#endif
+            default: break;
+        }
+    }
+    pin_digital_io_toggle(pin_id);
+}
+
+static inline __attribute__((always_inline))
+uint8_t pin_digital_io_fast_read(uint16_t pin_id)
+{
+    if (__builtin_constant_p(pin_id))
+    {
+        switch (PIN_ID_PORT(pin_id))
+        {
+#if defined(PINB)
+            case PIN_PORT_B: return (PINB >> PIN_ID_BIT(pin_id)) & 0x01;
+#endif
+#if defined(PINC)
+            case PIN_PORT_C: return (PINC >> PIN_ID_BIT(pin_id)) & 0x01;
+#endif
+#if defined(PIND)
+            case PIN_PORT_D: return (PIND >> PIN_ID_BIT(pin_id)) & 0x01;
+#endif
+            default: break;
+        }
+    }
+    return pin_digital_io_read(pin_id);
+}
+
+static inline __attribute__((always_inline))
+void pin_digital_io_fast_write_port_masked(uint8_t port, uint8_t mask, uint8_t value)
+{
+    if (__builtin_constant_p(port))
+    {
+        switch (port)
+        {
+#if defined(PORTB)
+            case PIN_PORT_B: PINB = (PORTB ^ value) & mask; return;
+#endif
+#if defined(PORTC)
+            case PIN_PORT_C: PINC = (PORTC ^ value) & mask; return;
+#endif
+#if defined(PORTD)
+            case PIN_PORT_D: PIND = (PORTD ^ value) & mask; return;
+#endif
+            default: break;
+        }
+    }
+    pin_digital_io_write_port_masked(port, mask, value);
+}
+
+#endif // AVR_HAL_PIN_DIGITAL_IO_H
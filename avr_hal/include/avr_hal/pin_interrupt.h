@@ -0,0 +1,86 @@
+/*
+ * External and pin change interrupt module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_PIN_INTERRUPT_H
+#define AVR_HAL_PIN_INTERRUPT_H
+
+#include <stdint.h>
+#include "avr_hal/pin_digital_io.h"
+#include "avr_hal/timer.h"
+
+/*
+ * Edges on the INT0/INT1 pins and on pins enabled for pin change interrupts
+ * are reported as events in a lock-free queue, timestamped with the tick
+ * counter. The events are read by a task, which also handles the debouncing.
+ *
+ * For a pin change event the source is the port (PIN_PORT_x), changed holds
+ * the pins that have changed and state the level of all pins in the port.
+ * For INT0/INT1 the source is PIN_INTERRUPT_INT0/INT1, changed is 1 and state
+ * is the level of the pin.
+ *
+ * Pin change interrupts and low level INT0/INT1 interrupts wake the MCU up
+ * from power down (see timer_idle), edge triggered INT0/INT1 interrupts only
+ * from idle mode.
+ */
+#define PIN_INTERRUPT_INT0 0x10
+#define PIN_INTERRUPT_INT1 0x11
+
+// The size of the event queue, must be a power of two (at most 128)
+#ifndef PIN_INTERRUPT_QUEUE_SIZE
+#define PIN_INTERRUPT_QUEUE_SIZE 8
+#endif
+
+// The values are the ISCn1:0 bits in EICRA (page 80 in the datasheet)
+typedef enum
+{
+    pin_interrupt_low_level,
+    pin_interrupt_any_edge,
+    pin_interrupt_falling_edge,
+    pin_interrupt_rising_edge
+} pin_interrupt_sense_t;
+
+typedef struct
+{
+    Tick_t tick;
+    uint8_t source;
+    uint8_t changed;
+    uint8_t state;
+} pin_interrupt_event_t;
+
+/*
+ * Enable INT0 (PD2) or INT1 (PD3), number is 0 or 1. Note that a low level
+ * interrupt fires continuously as long as the pin is low.
+ */
+void pin_interrupt_enable_external(uint8_t number, pin_interrupt_sense_t sense);
+void pin_interrupt_disable_external(uint8_t number);
+
+/*
+ * Enable or disable the pin change interrupt for a pin. Any edge generates
+ * an event. The pin id must be on PIN_PORT_B, C or D; port D is not
+ * available when building with BITLOOM_UART_WAKE.
+ *
+ * Returns 1 if the interrupt was enabled and 0 if the pin has no pin change
+ * interrupt. Disabling such a pin does nothing.
+ */
+uint8_t pin_interrupt_enable_change(uint16_t pin_id);
+void pin_interrupt_disable_change(uint16_t pin_id);
+
+/*
+ * Get the oldest event from the queue. Returns 1 if an event was read and 0
+ * if the queue is empty.
+ */
+uint8_t pin_interrupt_get_event(pin_interrupt_event_t *event);
+
+/*
+ * Returns the number of events dropped since the queue was full.
+ */
+uint16_t pin_interrupt_get_dropped(void);
+
+#endif // AVR_HAL_PIN_INTERRUPT_H
@@ -0,0 +1,79 @@
+/*
+ * CPU time profiler for tasks and interrupts.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_PROFILE_H
+#define AVR_HAL_PROFILE_H
+
+#include <stdint.h>
+
+/*
+ * The profiler is only included when building with BITLOOM_PROFILE. The
+ * PROFILE_ENTER and PROFILE_EXIT macros are empty otherwise, so they can be
+ * left in the code.
+ *
+ * Each slot keeps the number of calls and the min, max and total time in
+ * microseconds between enter and exit, measured with timer_now_us. Time
+ * spent in interrupts is included in the time of a task slot. Single
+ * measurements longer than 65 ms are not supported.
+ *
+ * The first slots are used by the HAL interrupts. The scheduler (or the
+ * application) uses PROFILE_SLOT_TASK(n) for the tasks.
+ */
+#ifndef PROFILE_TASK_SLOTS
+#define PROFILE_TASK_SLOTS 8
+#endif
+
+enum
+{
+    PROFILE_SLOT_TIMER0,
+    PROFILE_SLOT_UART_RX,
+    PROFILE_SLOT_UART_UDRE,
+    PROFILE_SLOT_TWI,
+    PROFILE_SLOT_FIRST_TASK
+};
+
+#define PROFILE_SLOT_TASK(n) (PROFILE_SLOT_FIRST_TASK + (n))
+#define PROFILE_SLOTS (PROFILE_SLOT_FIRST_TASK + PROFILE_TASK_SLOTS)
+
+#if defined(BITLOOM_PROFILE)
+
+void profile_enter (uint8_t slot);
+void profile_exit (uint8_t slot);
+
+/*
+ * Clear all slots.
+ */
+void profile_reset (void);
+
+/*
+ * Write all slots that have been used to the UART, one line per slot:
+ *
+ * PROF,<slot>,<count>,<min us>,<max us>,<total us>
+ *
+ * The dump doesn't block. Each call formats and starts sending the next line
+ * when the previous one has been sent, so a task calls it once per run
+ * (e.g. every tick) until it returns 0, when all lines have been handed to
+ * the UART. Returns 1 while the dump is in progress. The slots are read one
+ * at a time, so each line is consistent but they may be from different
+ * times. It uses uart_hal_send_buffer.
+ */
+uint8_t profile_dump (void);
+
+#define PROFILE_ENTER(slot) profile_enter(slot)
+#define PROFILE_EXIT(slot) profile_exit(slot)
+
+#else
+
+#define PROFILE_ENTER(slot) ((void) 0)
+#define PROFILE_EXIT(slot) ((void) 0)
+
+#endif // BITLOOM_PROFILE
+
+#endif // AVR_HAL_PROFILE_H
@@ -0,0 +1,89 @@
+/*
+ * Lock-free single producer, single consumer ring buffer for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_RING_H
+#define AVR_HAL_RING_H
+
+#include <stdint.h>
+
+/*
+ * The ring is written by one context (e.g. an interrupt) and read by one
+ * other context (e.g. a task). The head index is only written by the
+ * producer and the tail index only by the consumer. Since both are 8-bit
+ * they are read and written atomically and no interrupts need to be
+ * disabled on either side.
+ *
+ * The indexes are free running and masked when the data is accessed. The
+ * size must therefore be a power of two, and at most 128 so that the number
+ * of bytes in the ring always fits in the 8-bit difference of the indexes.
+ *
+ * All functions are inline so that an interrupt using the ring will not
+ * call any functions, which keeps the register save/restore to a minimum.
+ */
+typedef struct
+{
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    uint8_t mask;
+    uint8_t *data;
+} ring_t;
+
+// Prevent the compiler from moving data accesses across an index update
+#define RING_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+static inline void ring_init(ring_t *ring, uint8_t *data, uint8_t size)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->mask = size - 1;
+    ring->data = data;
+}
+
+static inline uint8_t ring_count(const ring_t *ring)
+{
+    return (uint8_t)(ring->head - ring->tail);
+}
+
+static inline uint8_t ring_is_empty(const ring_t *ring)
+{
+    return ring->head == ring->tail;
+}
+
+static inline uint8_t ring_is_full(const ring_t *ring)
+{
+    return ring_count(ring) > ring->mask;
+}
+
+/*
+ * Producer side. The caller must make sure that the ring isn't full.
+ */
+static inline void ring_put(ring_t *ring, uint8_t byte)
+{
+    uint8_t head = ring->head;
+
+    ring->data[head & ring->mask] = byte;
+    RING_BARRIER();
+    ring->head = head + 1;
+}
+
+/*
+ * Consumer side. The caller must make sure that the ring isn't empty.
+ */
+static inline uint8_t ring_get(ring_t *ring)
+{
+    uint8_t tail = ring->tail;
+    uint8_t byte = ring->data[tail & ring->mask];
+
+    RING_BARRIER();
+    ring->tail = tail + 1;
+    return byte;
+}
+
+#endif // AVR_HAL_RING_H
@@ -0,0 +1,87 @@
+/*
+ * SPI master module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_SPI_H
+#define AVR_HAL_SPI_H
+
+#include <stdint.h>
+
+// Chip select pin id for transfers without a chip select
+#define SPI_NO_CS 0xffff
+
+typedef enum
+{
+    spi_mode_0,     // CPOL = 0, CPHA = 0
+    spi_mode_1,     // CPOL = 0, CPHA = 1
+    spi_mode_2,     // CPOL = 1, CPHA = 0
+    spi_mode_3      // CPOL = 1, CPHA = 1
+} spi_mode_t;
+
+// The values are the SPI2X bit (bit 2) and the SPR1:0 bits (page 141)
+typedef enum
+{
+    spi_clock_div_2 = 0x04,
+    spi_clock_div_4 = 0x00,
+    spi_clock_div_8 = 0x05,
+    spi_clock_div_16 = 0x01,
+    spi_clock_div_32 = 0x06,
+    spi_clock_div_64 = 0x02,
+    spi_clock_div_128 = 0x03
+} spi_clock_t;
+
+/*
+ * Initialize the SPI as master, MSB first. MOSI, SCK and SS are set as
+ * outputs; SS must stay an output for the SPI to remain in master mode.
+ */
+void spi_init(spi_mode_t mode, spi_clock_t clock);
+
+/*
+ * Polled transfer of one byte. Returns the received byte.
+ */
+uint8_t spi_transfer(uint8_t data);
+
+/*
+ * Polled transfer of a block. If tx is NULL 0xff is sent, and if rx is NULL
+ * the received data is discarded. The next byte is fetched while the
+ * current one is shifted out, so at F_CPU/2 the bytes are sent with only a
+ * few cycles between them.
+ */
+void spi_transfer_block(const uint8_t *tx, uint8_t *rx, uint16_t length);
+
+/*
+ * Interrupt driven transfers, described by caller owned descriptors in the
+ * same way as the I2C engine in avr_hal/i2c_async.h. The chip select pin (a
+ * pin_digital_io pin id, or SPI_NO_CS) is driven low during the transfer.
+ * The length must be at least one.
+ *
+ * The callback, if set, is called from the SPI interrupt when the transfer
+ * is done and may submit a new transfer. The polled functions must not be
+ * used while the engine is busy.
+ */
+typedef struct spi_transfer spi_transfer_t;
+typedef void (*spi_callback_t)(spi_transfer_t *transfer);
+
+struct spi_transfer
+{
+    const uint8_t *tx_buffer;
+    uint8_t *rx_buffer;
+    uint16_t length;
+    uint16_t cs_pin;
+    spi_callback_t callback;
+
+    // Set by the engine
+    volatile uint8_t pending;
+    spi_transfer_t *next;
+};
+
+void spi_async_submit(spi_transfer_t *transfer);
+uint8_t spi_async_busy(void);
+
+#endif // AVR_HAL_SPI_H
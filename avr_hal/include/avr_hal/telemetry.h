@@ -0,0 +1,75 @@
+/*
+ * Framed binary telemetry over the UART module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_TELEMETRY_H
+#define AVR_HAL_TELEMETRY_H
+
+#include <stdint.h>
+
+/*
+ * Records are collected in a batch and sent as one frame, either when the
+ * batch is full or when telemetry_flush is called (e.g. by a periodic task).
+ * The frame is sent with uart_hal_send_buffer, so no other buffer
+ * transmission may be used at the same time.
+ *
+ * Frame before encoding, all values little endian:
+ *
+ *   tick     4 bytes   The tick counter at the first record
+ *   records  For each record:
+ *     type   1 byte
+ *     length 1 byte    Length of the data
+ *     delta  2 bytes   Ticks since the first record (65535 at most)
+ *     data   length bytes
+ *   crc      2 bytes   CRC-16/XMODEM of the bytes above, high byte first
+ *
+ * The frame is COBS encoded and terminated with a zero byte, so a receiver
+ * can always resynchronize at the next zero. tools/telemetry_decode.py
+ * decodes the frames.
+ *
+ * While a frame is being transmitted new records are added to the next
+ * batch. If the batch is full, records with a lower priority than the new
+ * one are dropped from it to make room, otherwise the new record is
+ * dropped. A record that is more than 65535 ticks after the start of the
+ * batch is also dropped if the batch cannot be sent, since its delta would
+ * not fit.
+ */
+
+// The size of the batch before encoding, including the tick and the crc.
+// At most 250 so that the encoded frame fits in a uart_hal_send_buffer call.
+#ifndef TELEMETRY_BATCH_SIZE
+#define TELEMETRY_BATCH_SIZE 64
+#endif
+
+// The maximum number of records in a batch
+#ifndef TELEMETRY_MAX_RECORDS
+#define TELEMETRY_MAX_RECORDS 16
+#endif
+
+/*
+ * Add a record to the batch. A higher priority value means a more important
+ * record. Returns 1 if the record was added and 0 if it was dropped. Must
+ * not be called from an interrupt.
+ */
+uint8_t telemetry_record(uint8_t type, uint8_t priority,
+                         const void *data, uint8_t length);
+
+/*
+ * Send the batch as a frame unless it is empty. Returns 0 if the previous
+ * frame (or another uart_hal_send_buffer transmission) is still in
+ * progress, in which case the batch is kept.
+ */
+uint8_t telemetry_flush(void);
+
+/*
+ * Returns the number of records that have been dropped.
+ */
+uint16_t telemetry_get_dropped(void);
+
+#endif // AVR_HAL_TELEMETRY_H
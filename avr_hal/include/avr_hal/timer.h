@@ -0,0 +1,153 @@
+/*
+ * AVR specific extensions to the timer module.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_TIMER_H
+#define AVR_HAL_TIMER_H
+
+#include <stdint.h>
+#include <avr/io.h>
+#include <config/timer_config.h>
+
+// The tick period in microseconds, normally set in the toolchain file
+#ifndef TICK_US
+#define TICK_US 1000UL
+#endif
+
+/*
+ * The tick counter that is updated by the timer interrupt.
+ */
+extern volatile Tick_t avr_ticks;
+
+/*
+ * Returns the tick counter without the risk of a torn read, i.e. a value
+ * where some bytes are read before and some after an increment.
+ *
+ * The counter is read until two consecutive reads give the same value. The
+ * interrupt only occurs once per tick, so at most one extra read is needed
+ * and interrupts are never disabled.
+ */
+static inline Tick_t timer_get_ticks (void)
+{
+    Tick_t ticks;
+
+    do
+    {
+        ticks = avr_ticks;
+    } while (ticks != avr_ticks);
+    return ticks;
+}
+
+/*
+ * Returns the number of ticks since the tick value since. The unsigned
+ * arithmetic handles a wraparound of the counter, as long as the interval is
+ * shorter than the range of Tick_t.
+ */
+static inline Tick_t timer_elapsed_since (Tick_t since)
+{
+    return (Tick_t)(timer_get_ticks() - since);
+}
+
+/*
+ * Returns the time in microseconds, based on the tick counter and the current
+ * value of the timer. The resolution is one timer count (8 us for a 1 ms
+ * tick at 1 and 8 MHz).
+ *
+ * The time wraps around together with the tick counter. If Tick_t is 16-bit
+ * only the lower 16 bits of the difference between two times are valid,
+ * i.e. intervals up to 65 ms can be measured.
+ */
+uint32_t timer_now_us (void);
+
+/*
+ * Tickless idle. Called by the scheduler when there is nothing to do for
+ * idle_ticks ticks.
+ *
+ * If power down is allowed, the period is long enough for the watchdog
+ * (16 ms, or the shortest timeout that is at least one tick) and no USART,
+ * TWI or ADC operation is ongoing, the timer is stopped and the MCU is
+ * powered down. It is woken up by the watchdog, using the longest timeouts
+ * that fit in the period, and the tick counter is corrected with the time
+ * slept. The watchdog oscillator is not calibrated, so the time may be off
+ * by some percent (see the datasheet).
+ *
+ * If the MCU is woken up by another interrupt the time of the interrupted
+ * watchdog period is not counted. While a pin change or external interrupt
+ * is enabled the watchdog timeout is therefore limited to 64 ms (set with
+ * TIMER_WDT_WAKE_PRESCALER, 16 ms << n), so at most that is lost per
+ * wakeup.
+ *
+ * A reset watchdog enabled by the application is suspended while the MCU
+ * is powered down and restored afterwards, with a full period. Note that
+ * the watchdog interrupt is used by this module and that receive on the
+ * USART only wakes up the MCU with uart_hal_wake_enable (see
+ * avr_hal/uart_hal.h). Power down is not used while a timeout is armed.
+ *
+ * Otherwise the MCU sleeps in idle mode until the next interrupt, which is
+ * at the latest the next tick.
+ *
+ * Returns the number of ticks the tick counter was corrected with.
+ */
+Tick_t timer_idle (Tick_t idle_ticks, uint8_t allow_power_down);
+
+/*
+ * Retriggerable one-shot timeout on the Timer 0 compare B interrupt, e.g. for
+ * an inter-byte timeout. There is a single timeout, owned by one user at a
+ * time (the UART idle line detection if enabled).
+ *
+ * The callback is called once from the interrupt when the timeout has not
+ * been retriggered for ticks ticks. The compare B interrupt occurs once per
+ * tick at a fixed phase, so the timeout expires between ticks - 1 and ticks
+ * tick periods after the last retrigger. ticks must be at least 1.
+ */
+typedef void (*timer_timeout_callback_t)(void);
+
+typedef struct
+{
+    uint8_t ticks;
+    volatile uint8_t remaining;
+    timer_timeout_callback_t callback;
+} timer_timeout_t;
+extern timer_timeout_t avr_timeout;
+
+/*
+ * Set the timeout and the callback. The timeout is not armed.
+ */
+void timer_timeout_init (uint8_t ticks, timer_timeout_callback_t callback);
+
+/*
+ * Arm the timeout, or restart it if it is already armed.
+ */
+void timer_timeout_start (void);
+
+/*
+ * Disarm the timeout without calling the callback.
+ */
+void timer_timeout_cancel (void);
+
+/*
+ * Same as timer_timeout_start, for use in interrupts (or with interrupts
+ * disabled). It is inline so that an interrupt that calls it doesn't have to
+ * save the call clobbered registers.
+ */
+static inline void timer_timeout_retrigger (void)
+{
+    avr_timeout.remaining = avr_timeout.ticks;
+    // The compare match flag is set every tick also while the interrupt is
+    // disabled, and would give an immediate first count down
+#if defined(TIMSK0)
+    TIFR0 = (1 << OCF0B);
+    TIMSK0 |= (1 << OCIE0B);
+#else
+    TIFR = (1 << OCF0B);
+    TIMSK |= (1 << OCIE0B);
+#endif
+}
+
+#endif // AVR_HAL_TIMER_H
@@ -0,0 +1,99 @@
+/*
+ * Hardware PWM and input capture module for AVR, using Timer 1 and Timer 2.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_TIMER_PWM_H
+#define AVR_HAL_TIMER_PWM_H
+
+#include <stdint.h>
+
+/*
+ * The outputs and their pins. OC1B is the SPI SS pin, which must stay an
+ * output in SPI master mode, and OC2A is the SPI MOSI pin, so these cannot
+ * be used together with the SPI module. OC2B is also the INT1 pin.
+ */
+typedef enum
+{
+    timer_pwm_oc1a,     // PB1
+    timer_pwm_oc1b,     // PB2
+    timer_pwm_oc2a,     // PB3
+    timer_pwm_oc2b      // PD3
+} timer_pwm_output_t;
+
+typedef enum
+{
+    timer_pwm_fast,
+    timer_pwm_phase_correct
+} timer_pwm_mode_t;
+
+// The values are the CS12:0 bits in TCCR1B (page 137 in the datasheet)
+typedef enum
+{
+    timer1_clock_div_1 = 1,
+    timer1_clock_div_8 = 2,
+    timer1_clock_div_64 = 3,
+    timer1_clock_div_256 = 4,
+    timer1_clock_div_1024 = 5
+} timer1_clock_t;
+
+// The values are the CS22:0 bits in TCCR2B (page 162)
+typedef enum
+{
+    timer2_clock_div_1 = 1,
+    timer2_clock_div_8 = 2,
+    timer2_clock_div_32 = 3,
+    timer2_clock_div_64 = 4,
+    timer2_clock_div_128 = 5,
+    timer2_clock_div_256 = 6,
+    timer2_clock_div_1024 = 7
+} timer2_clock_t;
+
+/*
+ * Run Timer 1 as a PWM timer with ICR1 as TOP. The PWM frequency is
+ * F_CPU / (clock * (top + 1)) in fast mode and F_CPU / (clock * 2 * top) in
+ * phase correct mode. Input capture cannot be used at the same time.
+ */
+void timer_pwm_init_timer1(timer_pwm_mode_t mode, timer1_clock_t clock,
+                           uint16_t top);
+
+/*
+ * Run Timer 2 as an 8-bit PWM timer with TOP 0xff.
+ */
+void timer_pwm_init_timer2(timer_pwm_mode_t mode, timer2_clock_t clock);
+
+/*
+ * Connect the output to its pin (which is set as an output) or disconnect
+ * it. The pin keeps its PORT value when disconnected.
+ */
+void timer_pwm_enable(timer_pwm_output_t output, uint8_t inverted);
+void timer_pwm_disable(timer_pwm_output_t output);
+
+/*
+ * Set the compare value, i.e. the duty cycle is duty / (top + 1). The value
+ * is updated by the hardware at TOP (fast) or BOTTOM (phase correct), so no
+ * glitches are produced. Only the low byte is used for Timer 2.
+ */
+void timer_pwm_set_duty(timer_pwm_output_t output, uint16_t duty);
+
+/*
+ * Measure pulses on ICP1 (PB0) with Timer 1 in normal mode. Each capture
+ * toggles the edge that is captured, so the widths of the high and the low
+ * part of the signal are measured in timer counts. Pulses longer than 65535
+ * counts are not measured correctly, choose the clock accordingly.
+ */
+void timer_capture_start(timer1_clock_t clock, uint8_t noise_canceler);
+void timer_capture_stop(void);
+
+/*
+ * Get the last measured widths. Returns non-zero if a new high pulse has
+ * been measured since the last call.
+ */
+uint8_t timer_capture_read(uint16_t *high, uint16_t *low);
+
+#endif // AVR_HAL_TIMER_PWM_H
@@ -0,0 +1,68 @@
+/*
+ * GPIO trace hooks for timing measurements with a logic analyzer.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_TRACE_H
+#define AVR_HAL_TRACE_H
+
+/*
+ * A trace channel is a pin on a port reserved for tracing. trace_enter sets
+ * the pin and trace_exit clears it, which with a constant channel on one of
+ * the lower I/O ports compiles to a single sbi/cbi instruction (2 cycles).
+ * trace_toggle uses the write-1-to-toggle feature of the PINx register.
+ *
+ * The hooks are only included when building with BITLOOM_TRACE. The
+ * application then provides config/trace_config.h that defines:
+ *
+ * TRACE_PORT, TRACE_DDR, TRACE_PIN - The registers of the trace port
+ * TRACE_MASK - The pins that are reserved for tracing
+ *
+ * and optionally the channels (pin numbers) for the HAL interrupts:
+ * TRACE_CH_TIMER0, TRACE_CH_UART_RX, TRACE_CH_UART_UDRE and TRACE_CH_TWI.
+ * Interrupts without a channel are not traced.
+ */
+#define TRACE_CH_NONE 0xff
+
+#if defined(BITLOOM_TRACE)
+
+#include <avr/io.h>
+#include "config/trace_config.h"
+
+#ifndef TRACE_CH_TIMER0
+#define TRACE_CH_TIMER0 TRACE_CH_NONE
+#endif
+#ifndef TRACE_CH_UART_RX
+#define TRACE_CH_UART_RX TRACE_CH_NONE
+#endif
+#ifndef TRACE_CH_UART_UDRE
+#define TRACE_CH_UART_UDRE TRACE_CH_NONE
+#endif
+#ifndef TRACE_CH_TWI
+#define TRACE_CH_TWI TRACE_CH_NONE
+#endif
+
+#define trace_init() \
+    do { TRACE_PORT &= ~(TRACE_MASK); TRACE_DDR |= (TRACE_MASK); } while (0)
+#define trace_enter(ch) \
+    do { if ((ch) < 8) TRACE_PORT |= (1 << ((ch) & 7)); } while (0)
+#define trace_exit(ch) \
+    do { if ((ch) < 8) TRACE_PORT &= ~(1 << ((ch) & 7)); } while (0)
+#define trace_toggle(ch) \
+    do { if ((ch) < 8) TRACE_PIN = (1 << ((ch) & 7)); } while (0)
+
+#else
+
+#define trace_init() ((void) 0)
+#define trace_enter(ch) ((void) 0)
+#define trace_exit(ch) ((void) 0)
+#define trace_toggle(ch) ((void) 0)
+
+#endif // BITLOOM_TRACE
+
+#endif // AVR_HAL_TRACE_H
@@ -0,0 +1,143 @@
+/*
+ * AVR specific extensions to the UART module.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_UART_HAL_H
+#define AVR_HAL_UART_HAL_H
+
+#include <stdint.h>
+#include "hal/uart_hal.h"
+#include "avr_hal/ring.h"
+
+/*
+ * On ATtiny the module is a software UART that only implements uart_hal_init,
+ * uart_hal_send and the receive statistics of the functions below. The idle
+ * line detection and wake on receive are only available with the USART.
+ */
+
+typedef enum
+{
+    uart_hal_ok,
+    uart_hal_busy
+} uart_hal_result_t;
+
+typedef void (*uart_hal_callback_t)(void);
+
+/*
+ * Receive statistics kept by the RX interrupt. The counters wrap around.
+ *
+ * received - Bytes read from the USART (including the erroneous ones)
+ * droppedFull - Bytes dropped since the in buffer was full
+ * overrun - Data overruns, i.e. bytes lost in the USART since the interrupt
+ *           wasn't served in time
+ * framingError - Bytes dropped due to a framing error (invalid stop bit)
+ * parityError - Bytes dropped due to a parity error
+ */
+typedef struct
+{
+    uint16_t received;
+    uint16_t droppedFull;
+    uint16_t overrun;
+    uint16_t framingError;
+    uint16_t parityError;
+} uart_hal_stats_t;
+
+/*
+ * Initialize the UART with inline ring buffers instead of bytebuffers. Only
+ * available when the module is built with UART_HAL_USE_RING, in which case
+ * it replaces uart_hal_init. The in buffer is written by the RX interrupt
+ * and the out buffer is read by the UDRE interrupt; the application uses the
+ * other end of each ring. Call uart_hal_send after writing to the out
+ * buffer.
+ */
+void uart_hal_init_ring(ring_t *inBuffer, ring_t *outBuffer);
+
+/*
+ * Transmit length bytes directly from a caller owned buffer, without copying
+ * them to the out buffer. The buffer must not be changed until the callback
+ * has been called (from the interrupt) when the last byte has been handed to
+ * the USART. The callback may start a new transmission.
+ *
+ * Only one buffer can be transmitted at a time; uart_hal_busy is returned if
+ * a buffer is already being transmitted. Data in the out buffer is sent when
+ * the buffer transmission is completed.
+ */
+uart_hal_result_t uart_hal_send_buffer(const uint8_t *data, uint8_t length,
+                                       uart_hal_callback_t callback);
+
+/*
+ * Same as uart_hal_send_buffer, but the data is located in program memory
+ * (PROGMEM).
+ */
+uart_hal_result_t uart_hal_send_buffer_P(const uint8_t *data, uint8_t length,
+                                         uart_hal_callback_t callback);
+
+/*
+ * Change the baud rate at runtime. The UBRR value is calculated for both
+ * normal and double speed (U2X) mode and the one with the lowest error is
+ * used. Normal speed is preferred if the errors are equal since it is more
+ * tolerant to clock differences.
+ *
+ * Returns the baud rate error in permille (1000 if the error is 100% or
+ * more). The caller is responsible for making sure that no transmission is
+ * ongoing when the baud rate is changed.
+ */
+uint16_t uart_hal_set_baud(uint32_t baud);
+
+/*
+ * Get a consistent copy of the receive statistics.
+ */
+void uart_hal_get_stats(uart_hal_stats_t *stats);
+
+/*
+ * Set all receive statistics counters to zero.
+ */
+void uart_hal_reset_stats(void);
+
+/*
+ * Idle line detection. The RX interrupt retriggers the timer timeout (see
+ * avr_hal/timer.h) for each received byte, and the callback is called once
+ * from the timer interrupt when no byte has been received for ticks ticks,
+ * i.e. when a command frame is complete. A task that handles the commands
+ * can then be scheduled from the callback instead of polling the in buffer.
+ *
+ * The timeout should be longer than the gap between the bytes of a frame
+ * from the host, and at least 2 ticks since the timeout expires between
+ * ticks - 1 and ticks tick periods after the last byte. The timer timeout
+ * cannot be used for anything else while the detection is enabled.
+ */
+void uart_hal_idle_enable(uint8_t ticks, uart_hal_callback_t callback);
+void uart_hal_idle_disable(void);
+
+#if defined(BITLOOM_UART_WAKE)
+/*
+ * Wake on receive, built with BITLOOM_UART_WAKE. The USART receiver is
+ * stopped in power down, so a pin change interrupt on RXD (PD0) is enabled
+ * instead. Call it before timer_idle each time power down may be used; the
+ * interrupt is disabled again when it has woken up the MCU.
+ *
+ * The bytes received while the MCU wakes up are corrupted. The RX interrupt
+ * therefore discards all bytes until the line has been idle for the idle
+ * line timeout, after which reception resumes with the next byte. The host
+ * must send a wakeup byte and wait for at least the timeout before sending
+ * the command. No idle callback is called for the discarded bytes.
+ *
+ * Requires the idle line detection to be enabled. The PCINT2 interrupt is
+ * owned by this module, so pin change interrupts on port D are not available
+ * from avr_hal/pin_interrupt.h.
+ */
+void uart_hal_wake_enable(void);
+
+/*
+ * Returns 1 while received bytes are discarded after a wakeup.
+ */
+uint8_t uart_hal_is_resyncing(void);
+#endif
+
+#endif // AVR_HAL_UART_HAL_H
@@ -0,0 +1,48 @@
+/*
+ * SPI master on the USART (Master SPI Mode, MSPIM) for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_UART_SPI_H
+#define AVR_HAL_UART_SPI_H
+
+#include <stdint.h>
+#include "avr_hal/spi.h"
+
+/*
+ * USART0 is used as a second SPI master: XCK0 (PD4) is SCK, TXD0 (PD1) is
+ * MOSI and RXD0 (PD0) is MISO. Unlike the SPI peripheral the transmit data
+ * register is double buffered, so bytes can be sent back-to-back without a
+ * gap. The module uses the USART interrupts and can therefore not be linked
+ * together with uart_hal.
+ *
+ * The transfer descriptors are the same as for the SPI module.
+ */
+
+/*
+ * Initialize USART0 in MSPIM mode, MSB first. The SCK frequency is
+ * F_CPU / (2 * (ubrr + 1)), i.e. ubrr 0 gives F_CPU/2.
+ */
+void uart_spi_init(spi_mode_t mode, uint16_t ubrr);
+
+/*
+ * Polled transfer of a block, see spi_transfer_block. When rx is NULL the
+ * bytes are streamed without gaps.
+ */
+void uart_spi_transfer_block(const uint8_t *tx, uint8_t *rx, uint16_t length);
+
+/*
+ * Interrupt driven transfers, see spi_async_submit. Transfers without an rx
+ * buffer are streamed from the UDRE interrupt and complete when the last
+ * bit has been shifted out. Transfers with an rx buffer keep two bytes in
+ * flight and are driven by the RX interrupt.
+ */
+void uart_spi_async_submit(spi_transfer_t *transfer);
+uint8_t uart_spi_async_busy(void);
+
+#endif // AVR_HAL_UART_SPI_H
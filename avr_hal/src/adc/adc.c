@@ -0,0 +1,175 @@
+/*
+ * Implementation of the ADC module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "avr_hal/adc.h"
+#include "avr_hal/ring.h"
+
+#define ADC_RING_MASK (ADC_RING_SIZE - 1)
+
+// The smallest prescaler that gives an ADC clock of at most 200 kHz
+// (page 208 in the datasheet)
+#define ADC_MAX_CLOCK 200000UL
+#if F_CPU / 2 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER_BITS (1 << ADPS0)
+#elif F_CPU / 4 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER_BITS (1 << ADPS1)
+#elif F_CPU / 8 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER_BITS ((1 << ADPS1) | (1 << ADPS0))
+#elif F_CPU / 16 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER_BITS (1 << ADPS2)
+#elif F_CPU / 32 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER_BITS ((1 << ADPS2) | (1 << ADPS0))
+#elif F_CPU / 64 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER_BITS ((1 << ADPS2) | (1 << ADPS1))
+#else
+#define ADC_PRESCALER_BITS ((1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0))
+#endif
+
+/*
+ * The ring works like the one in avr_hal/ring.h, with 16-bit samples, and
+ * uses its barrier.
+ */
+typedef struct
+{
+    uint16_t samples[ADC_RING_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    uint16_t overruns;
+    uint8_t reference;
+    uint8_t channels;
+    uint8_t channel;
+    adc_trigger_t trigger;
+} adc_t;
+static adc_t self;
+
+static inline void adc_select(uint8_t channel)
+{
+    ADMUX = (uint8_t)(self.reference << REFS0) | channel;
+}
+
+/*
+ * Returns the next channel in the mask after the given one.
+ */
+static uint8_t adc_next_channel(uint8_t channel)
+{
+    do
+    {
+        channel = (channel + 1) & 0x07;
+    } while (!(self.channels & (1 << channel)));
+    return channel;
+}
+
+void adc_init(adc_reference_t reference)
+{
+    self.reference = (uint8_t) reference;
+    adc_select(0);
+    ADCSRA = (1 << ADEN) | ADC_PRESCALER_BITS;
+}
+
+uint16_t adc_read(uint8_t channel)
+{
+    adc_select(channel);
+    ADCSRA |= (1 << ADSC);
+    while (ADCSRA & (1 << ADSC));
+    return ADC;
+}
+
+void adc_start(uint8_t channels, adc_trigger_t trigger)
+{
+    if (channels == 0)
+    {
+        return;
+    }
+
+    adc_stop();
+    self.channels = channels;
+    self.trigger = trigger;
+    self.channel = adc_next_channel(7);
+    adc_select(self.channel);
+
+    // Disable the digital input buffers of the analog pins (page 222)
+    DIDR0 |= channels & 0x3f;
+
+    ADCSRB = (uint8_t) trigger;
+    ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | (1 << ADIF) |
+             ADC_PRESCALER_BITS;
+}
+
+void adc_stop(void)
+{
+    ADCSRA = (1 << ADEN) | ADC_PRESCALER_BITS;
+    while (ADCSRA & (1 << ADSC));
+}
+
+uint8_t adc_read_block(uint16_t *samples, uint8_t max)
+{
+    uint8_t tail = self.tail;
+    uint8_t count = (uint8_t)(self.head - tail);
+    uint8_t i;
+
+    if (count > max)
+    {
+        count = max;
+    }
+    for (i = 0; i < count; ++i)
+    {
+        samples[i] = self.samples[(uint8_t)(tail + i) & ADC_RING_MASK];
+    }
+
+    RING_BARRIER();
+    self.tail = tail + count;
+    return count;
+}
+
+uint16_t adc_get_overruns(void)
+{
+    uint16_t overruns;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        overruns = self.overruns;
+    }
+    return overruns;
+}
+
+/*
+ * Conversion complete. The next channel is selected here, before the next
+ * trigger event starts the next conversion.
+ */
+ISR(ADC_vect)
+{
+    uint8_t head = self.head;
+    uint16_t sample = ((uint16_t) self.channel << 12) | ADC;
+
+    // The Timer 1 compare flag has no interrupt handler, and a new trigger
+    // needs a new rising edge of the flag
+    if (self.trigger == adc_trigger_timer1_compare_b)
+    {
+        TIFR1 = (1 << OCF1B);
+    }
+
+    if (self.channels & ~(1 << self.channel))
+    {
+        self.channel = adc_next_channel(self.channel);
+        adc_select(self.channel);
+    }
+
+    if ((uint8_t)(head - self.tail) > ADC_RING_MASK)
+    {
+        ++self.overruns;
+        return;
+    }
+    self.samples[head & ADC_RING_MASK] = sample;
+    RING_BARRIER();
+    self.head = head + 1;
+}
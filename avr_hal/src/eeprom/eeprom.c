@@ -0,0 +1,250 @@
+/*
+ * Implementation of the EEPROM module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "avr_hal/eeprom.h"
+
+#if !defined(EE_READY_vect) && defined(EE_RDY_vect)
+#define EE_READY_vect EE_RDY_vect
+#endif
+
+// Programming modes in EECR (page 22 in the datasheet). Erase and write
+// takes 3.4 ms, erase only and write only take 1.8 ms each.
+#define EEPROM_MODE_ERASE_WRITE 0
+#define EEPROM_MODE_ERASE (1 << EEPM0)
+#define EEPROM_MODE_WRITE (1 << EEPM1)
+
+// The number of unchanged bytes that are skipped per interrupt. Each EEPROM
+// read halts the CPU for 4 cycles, so the interrupt returns after a chunk
+// and is entered again after any other pending interrupt has been served.
+#define EEPROM_SKIP_CHUNK 8
+
+typedef struct
+{
+    eeprom_write_t *current;
+    eeprom_write_t *last;
+    uint8_t index;
+} eeprom_t;
+static eeprom_t self;
+
+/*
+ * Read a byte when no write is ongoing. Must be called with interrupts
+ * disabled.
+ */
+static inline uint8_t eeprom_read_register(uint16_t address)
+{
+    EEAR = address;
+    EECR |= (1 << EERE);
+    return EEDR;
+}
+
+void eeprom_write_submit(eeprom_write_t *write)
+{
+    write->next = 0;
+    write->pending = 1;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (self.current)
+        {
+            self.last->next = write;
+            self.last = write;
+        }
+        else
+        {
+            self.current = write;
+            self.last = write;
+            self.index = 0;
+
+            // The interrupt is triggered as long as no write is ongoing
+            EECR |= (1 << EERIE);
+        }
+    }
+}
+
+uint8_t eeprom_busy(void)
+{
+    return self.current != 0;
+}
+
+void eeprom_read(uint16_t address, uint8_t *buffer, uint8_t length)
+{
+    eeprom_write_t *write;
+    uint8_t byte;
+    uint8_t done;
+
+    while (length--)
+    {
+        do
+        {
+            // The interrupt may start a new byte write between the check
+            // and the read, so both are done with interrupts disabled
+            while (EECR & (1 << EEPE));
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                done = !(EECR & (1 << EEPE));
+                if (done)
+                {
+                    byte = eeprom_read_register(address);
+                    for (write = self.current; write; write = write->next)
+                    {
+                        if ((uint16_t)(address - write->address) < write->length)
+                        {
+                            byte = write->data[address - write->address];
+                        }
+                    }
+                }
+            }
+        } while (!done);
+
+        *buffer++ = byte;
+        ++address;
+    }
+}
+
+/*
+ * The status sequence breaks after the current slot. The area is only
+ * read here, the index and status are kept up to date by eeprom_wl_write.
+ */
+void eeprom_wl_init(eeprom_wl_t *wl, uint16_t address, uint8_t slots, uint8_t size)
+{
+    uint16_t status_address = address + (uint16_t) slots * size;
+    uint8_t status;
+    uint8_t next;
+    uint8_t i;
+
+    wl->address = address;
+    wl->slots = slots;
+    wl->size = size;
+    wl->record_write.pending = 0;
+    wl->status_write.pending = 0;
+
+    eeprom_read(status_address, &status, 1);
+    for (i = 0; i + 1 < slots; ++i)
+    {
+        eeprom_read(status_address + i + 1, &next, 1);
+        if (next != (uint8_t)(status + 1))
+        {
+            break;
+        }
+        status = next;
+    }
+    wl->index = i;
+    wl->status = status;
+}
+
+void eeprom_wl_read(eeprom_wl_t *wl, uint8_t *record)
+{
+    eeprom_read(wl->address + (uint16_t) wl->index * wl->size, record, wl->size);
+}
+
+uint8_t eeprom_wl_write(eeprom_wl_t *wl, const uint8_t *record)
+{
+    uint8_t index;
+
+    if (eeprom_wl_busy(wl))
+    {
+        return 0;
+    }
+
+    index = wl->index + 1 < wl->slots ? wl->index + 1 : 0;
+    wl->index = index;
+    wl->status++;
+
+    wl->record_write.address = wl->address + (uint16_t) index * wl->size;
+    wl->record_write.data = record;
+    wl->record_write.length = wl->size;
+    wl->record_write.callback = 0;
+
+    wl->status_write.address = wl->address + (uint16_t) wl->slots * wl->size + index;
+    wl->status_write.data = &wl->status;
+    wl->status_write.length = 1;
+    wl->status_write.callback = 0;
+
+    eeprom_write_submit(&wl->record_write);
+    eeprom_write_submit(&wl->status_write);
+    return 1;
+}
+
+uint8_t eeprom_wl_busy(const eeprom_wl_t *wl)
+{
+    return wl->record_write.pending || wl->status_write.pending;
+}
+
+/*
+ * The EEPROM ready interrupt is triggered when no write is ongoing. The next
+ * byte that differs from the EEPROM content is written, with erase only or
+ * write only programming when that is enough. The interrupt is level
+ * triggered, so returning without starting a write continues with the next
+ * chunk at once.
+ */
+ISR(EE_READY_vect)
+{
+    eeprom_write_t *write = self.current;
+    uint16_t address;
+    uint8_t old;
+    uint8_t data;
+    uint8_t mode;
+    uint8_t skip = EEPROM_SKIP_CHUNK;
+
+    while (self.index < write->length)
+    {
+        if (skip-- == 0)
+        {
+            return;
+        }
+
+        address = write->address + self.index;
+        data = write->data[self.index++];
+        old = eeprom_read_register(address);
+        if (old == data)
+        {
+            continue;
+        }
+
+        if (data == 0xff)
+        {
+            mode = EEPROM_MODE_ERASE;
+        }
+        else if ((old & data) == data)
+        {
+            // Only bits that change from 1 to 0
+            mode = EEPROM_MODE_WRITE;
+        }
+        else
+        {
+            mode = EEPROM_MODE_ERASE_WRITE;
+        }
+
+        // EEPE must be set within four cycles after EEMPE (page 21)
+        EEDR = data;
+        EECR = (1 << EERIE) | mode | (1 << EEMPE);
+        EECR |= (1 << EEPE);
+        return;
+    }
+
+    // All bytes are written, start the next write in the queue (if any)
+    self.current = write->next;
+    self.index = 0;
+    if (!self.current)
+    {
+        self.last = 0;
+        EECR &= ~(1 << EERIE);
+    }
+
+    write->next = 0;
+    write->pending = 0;
+    if (write->callback)
+    {
+        write->callback(write);
+    }
+}
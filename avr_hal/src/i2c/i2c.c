@@ -8,27 +8,141 @@
  *
  */
 
-#include "hal/i2c.h"
+#include "avr_hal/i2c.h"
+#include "avr_hal/timer.h"
+#include "i2c_internal.h"
+#include <util/delay.h>
 #include <util/twi.h>
 
-static void inline i2c_wait_for_complete (void)
+#ifndef I2C_SCL_HZ
+#define I2C_SCL_HZ 100000UL
+#endif
+
+/*
+ * SCL frequency = F_CPU / (16 + 2 * TWBR * 4^TWPS) (datasheet page 222).
+ *
+ * The smallest prescaler that gives a TWBR value within range is used, and
+ * the division is rounded up so that the bus never runs faster than
+ * I2C_SCL_HZ.
+ */
+#define I2C_SCL_DIVIDER ((F_CPU + I2C_SCL_HZ - 1) / I2C_SCL_HZ)
+#define I2C_TWBR_FOR(prescaler) \
+    ((I2C_SCL_DIVIDER - 16 + 2 * (prescaler) - 1) / (2 * (prescaler)))
+
+#if I2C_SCL_DIVIDER < 16
+#error "I2C_SCL_HZ is too high for F_CPU"
+#elif I2C_TWBR_FOR(1) <= 255
+#define I2C_TWPS_VALUE 0
+#define I2C_TWBR_VALUE I2C_TWBR_FOR(1)
+#elif I2C_TWBR_FOR(4) <= 255
+#define I2C_TWPS_VALUE (1 << TWPS0)
+#define I2C_TWBR_VALUE I2C_TWBR_FOR(4)
+#elif I2C_TWBR_FOR(16) <= 255
+#define I2C_TWPS_VALUE (1 << TWPS1)
+#define I2C_TWBR_VALUE I2C_TWBR_FOR(16)
+#elif I2C_TWBR_FOR(64) <= 255
+#define I2C_TWPS_VALUE ((1 << TWPS1) | (1 << TWPS0))
+#define I2C_TWBR_VALUE I2C_TWBR_FOR(64)
+#else
+#error "I2C_SCL_HZ is too low for F_CPU"
+#endif
+
+#ifndef I2C_TIMEOUT_TICKS
+#define I2C_TIMEOUT_TICKS 10
+#endif
+
+// The TWI pins are used as GPIO when the bus is cleared
+#ifndef I2C_PORT
+#define I2C_PORT PORTC
+#define I2C_DDR DDRC
+#define I2C_PIN PINC
+#define I2C_SDA_BIT PORTC4
+#define I2C_SCL_BIT PORTC5
+#endif
+
+#define I2C_HALF_PERIOD_US (500000.0 / I2C_SCL_HZ)
+
+/*
+ * Wait until the bits in mask of TWCR have the given value. The wait is
+ * bounded by I2C_TIMEOUT_TICKS. If the hardware doesn't finish in time the
+ * bus is cleared and i2c_timeout is returned.
+ *
+ * Note that the tick counter must be running, i.e. the timer must have been
+ * started and interrupts must be enabled.
+ */
+static i2c_result_t i2c_wait_for (uint8_t mask, uint8_t value)
 {
-    while (!(TWCR & (1 << TWINT)));
+    Tick_t start = timer_get_ticks();
+
+    while ((TWCR & mask) != value)
+    {
+        if (timer_elapsed_since(start) > I2C_TIMEOUT_TICKS)
+        {
+            i2c_bus_clear();
+            return i2c_timeout;
+        }
+    }
+    return i2c_ok;
+}
+
+static inline i2c_result_t i2c_wait_for_complete (void)
+{
+    return i2c_wait_for((1 << TWINT), (1 << TWINT));
 }
 
 void i2c_init (void)
 {
-    // TWBR – TWI Bit Rate Register
-    // Datasheet page 230
-    TWBR = 32;  // 50 kHz
+    // TWBR – TWI Bit Rate Register and TWPS - TWI Prescaler Bits
+    // Datasheet page 230 and 232
+    TWSR = I2C_TWPS_VALUE;
+    TWBR = I2C_TWBR_VALUE;
     TWCR |= (1 << TWEN);
 }
 
+void i2c_bus_clear (void)
+{
+    uint8_t pins = (1 << I2C_SCL_BIT) | (1 << I2C_SDA_BIT);
+    uint8_t pull_ups = I2C_PORT & pins;
+    uint8_t pulse;
+
+    // Take the pins from the TWI module. The lines are open drain, i.e. they
+    // are driven low by setting the pin as output and released (pulled high)
+    // by setting it as input.
+    TWCR = 0;
+    I2C_PORT &= ~pins;
+    I2C_DDR &= ~pins;
+
+    // Clock out up to 9 pulses until the slave releases SDA
+    for (pulse = 0; pulse < 9 && !(I2C_PIN & (1 << I2C_SDA_BIT)); pulse++)
+    {
+        I2C_DDR |= (1 << I2C_SCL_BIT);
+        _delay_us(I2C_HALF_PERIOD_US);
+        I2C_DDR &= ~(1 << I2C_SCL_BIT);
+        _delay_us(I2C_HALF_PERIOD_US);
+    }
+
+    // STOP condition, SDA goes high while SCL is high
+    I2C_DDR |= (1 << I2C_SCL_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_DDR |= (1 << I2C_SDA_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_DDR &= ~(1 << I2C_SCL_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_DDR &= ~(1 << I2C_SDA_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+
+    I2C_PORT |= pull_ups;
+    TWCR = (1 << TWEN);
+}
+
 i2c_result_t i2c_start (void)
 {
     // Datasheet page 220
     TWCR |= (1 << TWINT) | (1 << TWEN) | (1 << TWSTA);
-    i2c_wait_for_complete();
+    if (i2c_wait_for_complete() != i2c_ok)
+    {
+        return i2c_timeout;
+    }
 
     if (TW_STATUS != TW_START)
     {
@@ -40,7 +154,10 @@ i2c_result_t i2c_start (void)
 i2c_result_t i2c_restart (void)
 {
     TWCR |= (1 << TWINT) | (1 << TWEN) | (1 << TWSTA);
-    i2c_wait_for_complete();
+    if (i2c_wait_for_complete() != i2c_ok)
+    {
+        return i2c_timeout;
+    }
     if (TW_STATUS != TW_REP_START)
     {
         return i2c_operation_error;
@@ -51,22 +168,29 @@ i2c_result_t i2c_restart (void)
 void i2c_stop (void)
 {
     TWCR |= (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
-    while (!(TWCR & (1 << TWSTO)));
+
+    // TWSTO is cleared by the hardware when the STOP condition has been sent
+    i2c_wait_for((1 << TWSTO), 0);
 }
 
 i2c_result_t i2c_write_byte (uint8_t byte)
 {
     TWDR = byte;
     TWCR = (1 << TWINT) | (1 << TWEN);
-    i2c_wait_for_complete();
+    if (i2c_wait_for_complete() != i2c_ok)
+    {
+        return i2c_timeout;
+    }
 
     switch (TW_STATUS)
     {
         case TW_MT_SLA_ACK:
         case TW_MT_DATA_ACK:
+        case TW_MR_SLA_ACK:
             return i2c_ack_received;
         case TW_MT_SLA_NACK:
         case TW_MT_DATA_NACK:
+        case TW_MR_SLA_NACK:
             return i2c_nack_received;
         case TW_MT_ARB_LOST:
             return i2c_arbitration_lost;
@@ -75,8 +199,34 @@ i2c_result_t i2c_write_byte (uint8_t byte)
     }
 }
 
+i2c_result_t i2c_receive (uint8_t *byte, uint8_t send_ack)
+{
+    // Datasheet page 230. TWEA decides if the byte is ACKed or not.
+    TWCR = (1 << TWINT) | (1 << TWEN) | (send_ack ? (1 << TWEA) : 0);
+    if (i2c_wait_for_complete() != i2c_ok)
+    {
+        *byte = 0;
+        return i2c_timeout;
+    }
+    *byte = TWDR;
+
+    switch (TW_STATUS)
+    {
+        case TW_MR_DATA_ACK:
+            return i2c_ack_received;
+        case TW_MR_DATA_NACK:
+            return i2c_nack_received;
+        case TW_MR_ARB_LOST:
+            return i2c_arbitration_lost;
+        default:
+            return i2c_operation_error;
+    }
+}
+
 uint8_t i2c_read_byte (uint8_t send_ack)
 {
-    // Not implemented
-    return i2c_operation_error;
+    uint8_t byte;
+
+    i2c_receive(&byte, send_ack);
+    return byte;
 }
@@ -0,0 +1,179 @@
+/*
+ * Implementation of the interrupt driven I2C master engine for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+#include "avr_hal/i2c_async.h"
+#include "avr_hal/profile.h"
+#include "avr_hal/trace.h"
+
+// TWCR value used for all steps handled by the engine. Writing TWINT clears
+// the flag and starts the next operation on the bus.
+#define TWCR_NEXT ((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+
+typedef struct
+{
+    i2c_transaction_t *current;
+    i2c_transaction_t *last;
+    uint8_t write_index;
+    uint8_t read_index;
+} i2c_async_t;
+static i2c_async_t self;
+
+static void i2c_async_begin (uint8_t control)
+{
+    self.write_index = 0;
+    self.read_index = 0;
+
+    // Datasheet page 220. If TWSTO is also set the STOP condition for the
+    // previous transaction is sent before the START condition.
+    TWCR = TWCR_NEXT | (1 << TWSTA) | control;
+}
+
+/*
+ * Complete the current transaction and start the next one in the queue (if
+ * any). A STOP condition is sent unless the bus has been lost to another
+ * master, in which case the bus is just released.
+ */
+static void i2c_async_finish (i2c_result_t result, uint8_t send_stop)
+{
+    i2c_transaction_t *transaction = self.current;
+    uint8_t control = send_stop ? (1 << TWSTO) : 0;
+
+    self.current = transaction->next;
+    if (self.current)
+    {
+        i2c_async_begin(control);
+    }
+    else
+    {
+        self.last = 0;
+        TWCR = (1 << TWINT) | (1 << TWEN) | control;
+    }
+
+    transaction->next = 0;
+    transaction->result = result;
+    transaction->pending = 0;
+
+    if (transaction->callback)
+    {
+        transaction->callback(transaction);
+    }
+}
+
+void i2c_async_submit (i2c_transaction_t *transaction)
+{
+    transaction->next = 0;
+    transaction->pending = 1;
+    transaction->result = i2c_ok;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (self.current)
+        {
+            self.last->next = transaction;
+            self.last = transaction;
+        }
+        else
+        {
+            self.current = transaction;
+            self.last = transaction;
+            i2c_async_begin(0);
+        }
+    }
+}
+
+uint8_t i2c_async_busy (void)
+{
+    return self.current != 0;
+}
+
+/*
+ * The TWI interrupt is triggered each time the hardware has finished a step
+ * on the bus. The status register tells what happened (datasheet page 227
+ * and 230) and the next step is started from here.
+ */
+ISR(TWI_vect)
+{
+    i2c_transaction_t *transaction = self.current;
+
+    trace_enter(TRACE_CH_TWI);
+    PROFILE_ENTER(PROFILE_SLOT_TWI);
+    switch (TW_STATUS)
+    {
+        case TW_START:
+        case TW_REP_START:
+            if (self.write_index < transaction->write_length ||
+                transaction->read_length == 0)
+            {
+                TWDR = (uint8_t)(transaction->address << 1) | TW_WRITE;
+            }
+            else
+            {
+                TWDR = (uint8_t)(transaction->address << 1) | TW_READ;
+            }
+            TWCR = TWCR_NEXT;
+            break;
+
+        case TW_MT_SLA_ACK:
+        case TW_MT_DATA_ACK:
+            if (self.write_index < transaction->write_length)
+            {
+                TWDR = transaction->write_buffer[self.write_index++];
+                TWCR = TWCR_NEXT;
+            }
+            else if (transaction->read_length)
+            {
+                TWCR = TWCR_NEXT | (1 << TWSTA);
+            }
+            else
+            {
+                i2c_async_finish(i2c_ok, 1);
+            }
+            break;
+
+        case TW_MR_DATA_ACK:
+            transaction->read_buffer[self.read_index++] = TWDR;
+            // Fall through
+        case TW_MR_SLA_ACK:
+            // ACK all bytes but the last one
+            if (transaction->read_length - self.read_index > 1)
+            {
+                TWCR = TWCR_NEXT | (1 << TWEA);
+            }
+            else
+            {
+                TWCR = TWCR_NEXT;
+            }
+            break;
+
+        case TW_MR_DATA_NACK:
+            transaction->read_buffer[self.read_index++] = TWDR;
+            i2c_async_finish(i2c_ok, 1);
+            break;
+
+        case TW_MT_SLA_NACK:
+        case TW_MT_DATA_NACK:
+        case TW_MR_SLA_NACK:
+            i2c_async_finish(i2c_nack_received, 1);
+            break;
+
+        case TW_MT_ARB_LOST:
+            i2c_async_finish(i2c_arbitration_lost, 0);
+            break;
+
+        default:
+            i2c_async_finish(i2c_operation_error, 1);
+            break;
+    }
+    PROFILE_EXIT(PROFILE_SLOT_TWI);
+    trace_exit(TRACE_CH_TWI);
+}
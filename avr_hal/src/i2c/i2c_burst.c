@@ -0,0 +1,87 @@
+/*
+ * Implementation of the I2C burst read for AVR, shared by the TWI and the
+ * USI implementation of the I2C module.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include "avr_hal/i2c.h"
+#include "i2c_internal.h"
+
+static i2c_result_t i2c_expect_ack (i2c_result_t result)
+{
+    return result == i2c_ack_received ? i2c_ok : result;
+}
+
+/*
+ * The register pointer is written, followed by a repeated start and the
+ * read of all bytes. All bytes but the last are ACKed.
+ */
+static i2c_result_t i2c_burst_transfer (uint8_t address, uint8_t reg,
+                                        uint8_t *buffer, uint8_t length)
+{
+    i2c_result_t result;
+
+    result = i2c_expect_ack(i2c_write_byte((uint8_t)(address << 1) | I2C_WRITE));
+    if (result == i2c_ok)
+    {
+        result = i2c_expect_ack(i2c_write_byte(reg));
+    }
+    if (result == i2c_ok)
+    {
+        result = i2c_restart();
+    }
+    if (result == i2c_ok)
+    {
+        result = i2c_expect_ack(i2c_write_byte((uint8_t)(address << 1) | I2C_READ));
+    }
+    if (result != i2c_ok)
+    {
+        return result;
+    }
+
+    while (length--)
+    {
+        result = i2c_receive(buffer++, length != 0);
+        if (result != (length ? i2c_ack_received : i2c_nack_received))
+        {
+            if (result == i2c_arbitration_lost || result == i2c_timeout)
+            {
+                return result;
+            }
+            return i2c_operation_error;
+        }
+    }
+    return i2c_ok;
+}
+
+i2c_result_t i2c_read_burst (uint8_t address, uint8_t reg,
+                             uint8_t *buffer, uint8_t length)
+{
+    i2c_result_t result;
+
+    if (length == 0)
+    {
+        return i2c_operation_error;
+    }
+
+    result = i2c_start();
+    if (result != i2c_ok)
+    {
+        return result;
+    }
+
+    result = i2c_burst_transfer(address, reg, buffer, length);
+
+    // The bus is no longer owned if the arbitration was lost, and it has
+    // already been released if the operation timed out
+    if (result != i2c_arbitration_lost && result != i2c_timeout)
+    {
+        i2c_stop();
+    }
+    return result;
+}
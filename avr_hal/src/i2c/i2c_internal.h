@@ -0,0 +1,27 @@
+/*
+ * Functions shared by the implementations of the I2C module.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef AVR_HAL_I2C_INTERNAL_H
+#define AVR_HAL_I2C_INTERNAL_H
+
+#include <stdint.h>
+#include "avr_hal/i2c.h"
+
+// The R/W bit of the address byte
+#define I2C_WRITE 0
+#define I2C_READ 1
+
+/*
+ * Receive one byte in master receiver mode and return the bus status. The
+ * result tells if an ACK or a NACK was sent to the slave after the byte.
+ */
+i2c_result_t i2c_receive (uint8_t *byte, uint8_t send_ack);
+
+#endif // AVR_HAL_I2C_INTERNAL_H
@@ -0,0 +1,247 @@
+/*
+ * Implementation of the I2C module for AVR devices with a USI (e.g. the
+ * ATtiny25/45/85) instead of a TWI module.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <util/delay.h>
+#include "avr_hal/i2c.h"
+#include "avr_hal/timer.h"
+#include "i2c_internal.h"
+
+#ifndef I2C_SCL_HZ
+#define I2C_SCL_HZ 100000UL
+#endif
+
+#if I2C_SCL_HZ > 400000UL
+#error "I2C_SCL_HZ is too high, the USI master supports at most 400 kHz"
+#endif
+
+#ifndef I2C_TIMEOUT_TICKS
+#define I2C_TIMEOUT_TICKS 10
+#endif
+
+#ifndef I2C_PORT
+#define I2C_PORT PORTB
+#define I2C_DDR DDRB
+#define I2C_PIN PINB
+#define I2C_SDA_BIT PORTB0
+#define I2C_SCL_BIT PORTB2
+#endif
+
+/*
+ * The USI only shifts the data, the clock is generated by software. The
+ * delays give at most I2C_SCL_HZ, the time spent in the code makes the
+ * actual frequency somewhat lower.
+ */
+#define I2C_HALF_PERIOD_US (500000.0 / I2C_SCL_HZ)
+
+// Two-wire mode with the counter clocked by software strobes of USITC, which
+// also toggles SCL (ATtiny85 datasheet page 124)
+#define I2C_USICR_IDLE ((1 << USIWM1) | (1 << USICS1) | (1 << USICLK))
+#define I2C_USICR_TOGGLE (I2C_USICR_IDLE | (1 << USITC))
+
+// Clear all flags and preset the counter, which counts both clock edges
+#define I2C_USISR_FLAGS ((1 << USISIF) | (1 << USIOIF) | (1 << USIPF) | (1 << USIDC))
+#define I2C_USISR_8_BITS (I2C_USISR_FLAGS | 0x00)
+#define I2C_USISR_1_BIT (I2C_USISR_FLAGS | 0x0e)
+
+/*
+ * Wait until SCL is high, i.e. the slave doesn't stretch the clock. The
+ * wait is bounded by I2C_TIMEOUT_TICKS as in the TWI implementation, after
+ * which the bus is cleared and i2c_timeout is returned.
+ */
+static i2c_result_t i2c_wait_scl_high (void)
+{
+    Tick_t start = timer_get_ticks();
+
+    while (!(I2C_PIN & (1 << I2C_SCL_BIT)))
+    {
+        if (timer_elapsed_since(start) > I2C_TIMEOUT_TICKS)
+        {
+            i2c_bus_clear();
+            return i2c_timeout;
+        }
+    }
+    return i2c_ok;
+}
+
+/*
+ * Clock the bits of USIDR out on SDA, and the bits on SDA in, until the
+ * counter overflows. SCL is low before and after. SDA is released at the
+ * end.
+ */
+static i2c_result_t i2c_transfer (uint8_t status, uint8_t *data)
+{
+    USISR = status;
+    do
+    {
+        _delay_us(I2C_HALF_PERIOD_US);
+        USICR = I2C_USICR_TOGGLE;
+        if (i2c_wait_scl_high() != i2c_ok)
+        {
+            return i2c_timeout;
+        }
+        _delay_us(I2C_HALF_PERIOD_US);
+        USICR = I2C_USICR_TOGGLE;
+    } while (!(USISR & (1 << USIOIF)));
+
+    _delay_us(I2C_HALF_PERIOD_US);
+    *data = USIDR;
+
+    // SDA is driven low if either USIDR bit 7 or the PORT bit is zero
+    USIDR = 0xff;
+    I2C_DDR |= (1 << I2C_SDA_BIT);
+    return i2c_ok;
+}
+
+void i2c_init (void)
+{
+    uint8_t pins = (1 << I2C_SCL_BIT) | (1 << I2C_SDA_BIT);
+
+    // Both lines released
+    I2C_PORT |= pins;
+    I2C_DDR |= pins;
+    USIDR = 0xff;
+    USICR = I2C_USICR_IDLE;
+    USISR = I2C_USISR_FLAGS;
+}
+
+void i2c_bus_clear (void)
+{
+    uint8_t pins = (1 << I2C_SCL_BIT) | (1 << I2C_SDA_BIT);
+    uint8_t pulse;
+
+    // Take the pins from the USI, the lines are driven as in the TWI
+    // implementation
+    USICR = 0;
+    I2C_PORT &= ~pins;
+    I2C_DDR &= ~pins;
+
+    // Clock out up to 9 pulses until the slave releases SDA
+    for (pulse = 0; pulse < 9 && !(I2C_PIN & (1 << I2C_SDA_BIT)); pulse++)
+    {
+        I2C_DDR |= (1 << I2C_SCL_BIT);
+        _delay_us(I2C_HALF_PERIOD_US);
+        I2C_DDR &= ~(1 << I2C_SCL_BIT);
+        _delay_us(I2C_HALF_PERIOD_US);
+    }
+
+    // STOP condition, SDA goes high while SCL is high
+    I2C_DDR |= (1 << I2C_SCL_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_DDR |= (1 << I2C_SDA_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_DDR &= ~(1 << I2C_SCL_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_DDR &= ~(1 << I2C_SDA_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+
+    i2c_init();
+}
+
+/*
+ * START condition, SDA goes low while SCL is high. SDA is released before
+ * SCL, so the same sequence gives a repeated start.
+ */
+static i2c_result_t i2c_start_condition (void)
+{
+    USISR = I2C_USISR_FLAGS;
+    I2C_PORT |= (1 << I2C_SCL_BIT);
+    if (i2c_wait_scl_high() != i2c_ok)
+    {
+        return i2c_timeout;
+    }
+    _delay_us(I2C_HALF_PERIOD_US);
+
+    I2C_PORT &= ~(1 << I2C_SDA_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_PORT &= ~(1 << I2C_SCL_BIT);
+    I2C_PORT |= (1 << I2C_SDA_BIT);
+
+    // The start condition detector tells if the START was seen on the bus
+    if (!(USISR & (1 << USISIF)))
+    {
+        return i2c_operation_error;
+    }
+    return i2c_ok;
+}
+
+i2c_result_t i2c_start (void)
+{
+    return i2c_start_condition();
+}
+
+i2c_result_t i2c_restart (void)
+{
+    return i2c_start_condition();
+}
+
+void i2c_stop (void)
+{
+    I2C_PORT &= ~(1 << I2C_SDA_BIT);
+    I2C_PORT |= (1 << I2C_SCL_BIT);
+    if (i2c_wait_scl_high() != i2c_ok)
+    {
+        return;
+    }
+    _delay_us(I2C_HALF_PERIOD_US);
+    I2C_PORT |= (1 << I2C_SDA_BIT);
+    _delay_us(I2C_HALF_PERIOD_US);
+}
+
+/*
+ * The USI cannot detect a lost arbitration, so i2c_arbitration_lost is
+ * never returned. Only single master buses are supported.
+ */
+i2c_result_t i2c_write_byte (uint8_t byte)
+{
+    uint8_t ack;
+
+    USIDR = byte;
+    if (i2c_transfer(I2C_USISR_8_BITS, &ack) != i2c_ok)
+    {
+        return i2c_timeout;
+    }
+
+    // The slave drives SDA low during the ninth clock to ACK the byte
+    I2C_DDR &= ~(1 << I2C_SDA_BIT);
+    if (i2c_transfer(I2C_USISR_1_BIT, &ack) != i2c_ok)
+    {
+        return i2c_timeout;
+    }
+    return (ack & 0x01) ? i2c_nack_received : i2c_ack_received;
+}
+
+i2c_result_t i2c_receive (uint8_t *byte, uint8_t send_ack)
+{
+    uint8_t unused;
+
+    I2C_DDR &= ~(1 << I2C_SDA_BIT);
+    if (i2c_transfer(I2C_USISR_8_BITS, byte) != i2c_ok)
+    {
+        *byte = 0;
+        return i2c_timeout;
+    }
+
+    USIDR = send_ack ? 0x00 : 0xff;
+    if (i2c_transfer(I2C_USISR_1_BIT, &unused) != i2c_ok)
+    {
+        return i2c_timeout;
+    }
+    return send_ack ? i2c_ack_received : i2c_nack_received;
+}
+
+uint8_t i2c_read_byte (uint8_t send_ack)
+{
+    uint8_t byte;
+
+    i2c_receive(&byte, send_ack);
+    return byte;
+}
@@ -10,16 +10,109 @@
 
 #include <stdint.h>
 #include <avr/io.h>
+#include <util/atomic.h>
+#include "avr_hal/pin_digital_io.h"
 #include "config/port_config.h"
 
+// The PINx, DDRx and PORTx registers of a port are located at consecutive
+// addresses, so only the address of PINx is kept in the port table.
+#define PIN_REGISTER_PIN 0
+#define PIN_REGISTER_DDR 1
+#define PIN_REGISTER_PORT 2
+
+static volatile uint8_t * const pin_digital_io_ports[] =
+{
+    [PIN_PORT_LED] = &LED_PORT - PIN_REGISTER_PORT,
+#if defined(PINB)
+    [PIN_PORT_B] = &PINB,
+#endif
+#if defined(PINC)
+    [PIN_PORT_C] = &PINC,
+#endif
+#if defined(PIND)
+    [PIN_PORT_D] = &PIND,
+#endif
+};
+
+// A table lookup avoids the shift loop for a variable bit number
+static const uint8_t pin_digital_io_masks[] =
+{
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80
+};
+
+static inline volatile uint8_t *pin_digital_io_register(uint16_t pin_id, uint8_t offset)
+{
+    return pin_digital_io_ports[PIN_ID_PORT(pin_id)] + offset;
+}
 
 void pin_digital_io_write_high(uint16_t pin_id)
 {
-    LED_PORT |= (1u << pin_id);
+    volatile uint8_t *port = pin_digital_io_register(pin_id, PIN_REGISTER_PORT);
+    uint8_t mask = pin_digital_io_masks[PIN_ID_BIT(pin_id)];
+
+    // The read-modify-write must not be interrupted by an interrupt that
+    // writes to the same port
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *port |= mask;
+    }
 }
 
 void pin_digital_io_write_low(uint16_t pin_id)
 {
-    LED_PORT &= ~(1u << pin_id);
+    volatile uint8_t *port = pin_digital_io_register(pin_id, PIN_REGISTER_PORT);
+    uint8_t mask = pin_digital_io_masks[PIN_ID_BIT(pin_id)];
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *port &= ~mask;
+    }
+}
+
+void pin_digital_io_set_mode(uint16_t pin_id, pin_digital_io_mode_t mode)
+{
+    volatile uint8_t *ddr = pin_digital_io_register(pin_id, PIN_REGISTER_DDR);
+    volatile uint8_t *port = pin_digital_io_register(pin_id, PIN_REGISTER_PORT);
+    uint8_t mask = pin_digital_io_masks[PIN_ID_BIT(pin_id)];
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        switch (mode)
+        {
+            case pin_digital_io_input:
+                *ddr &= ~mask;
+                *port &= ~mask;
+                break;
+            case pin_digital_io_input_pullup:
+                *ddr &= ~mask;
+                *port |= mask;
+                break;
+            case pin_digital_io_output:
+                *ddr |= mask;
+                break;
+        }
+    }
+}
+
+uint8_t pin_digital_io_read(uint16_t pin_id)
+{
+    volatile uint8_t *pin = pin_digital_io_register(pin_id, PIN_REGISTER_PIN);
+
+    return (*pin & pin_digital_io_masks[PIN_ID_BIT(pin_id)]) ? 1 : 0;
+}
+
+void pin_digital_io_toggle(uint16_t pin_id)
+{
+    volatile uint8_t *pin = pin_digital_io_register(pin_id, PIN_REGISTER_PIN);
+
+    // Writing a one to PINx toggles the pin (page 60 in the datasheet)
+    *pin = pin_digital_io_masks[PIN_ID_BIT(pin_id)];
 }
 
+void pin_digital_io_write_port_masked(uint8_t port, uint8_t mask, uint8_t value)
+{
+    volatile uint8_t *pin = pin_digital_io_ports[port];
+
+    // Toggle the pins in the mask that differ from the value
+    *pin = (*(pin + PIN_REGISTER_PORT) ^ value) & mask;
+}
@@ -0,0 +1,226 @@
+/*
+ * Implementation of the external and pin change interrupt module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "avr_hal/pin_interrupt.h"
+#include "avr_hal/ring.h"
+
+#define PIN_INTERRUPT_QUEUE_MASK (PIN_INTERRUPT_QUEUE_SIZE - 1)
+
+// Port B, C and D are pin change groups 0, 1 and 2 (page 82)
+#define PIN_INTERRUPT_GROUPS 3
+
+/*
+ * The queue works like the ring in avr_hal/ring.h, with events instead of
+ * bytes, and uses its barrier. The interrupts that write to it don't nest,
+ * so together they are a single producer.
+ */
+typedef struct
+{
+    pin_interrupt_event_t events[PIN_INTERRUPT_QUEUE_SIZE];
+    volatile uint8_t head;
+    volatile uint8_t tail;
+    uint16_t dropped;
+    uint8_t lastState[PIN_INTERRUPT_GROUPS];
+} pin_interrupt_t;
+static pin_interrupt_t self;
+
+static volatile uint8_t * const pin_interrupt_masks[PIN_INTERRUPT_GROUPS] =
+{
+    &PCMSK0, &PCMSK1, &PCMSK2
+};
+
+static volatile uint8_t * const pin_interrupt_pins[PIN_INTERRUPT_GROUPS] =
+{
+    &PINB, &PINC, &PIND
+};
+
+/*
+ * Called from the interrupts only.
+ */
+static void pin_interrupt_push(uint8_t source, uint8_t changed, uint8_t state)
+{
+    uint8_t head = self.head;
+    pin_interrupt_event_t *event;
+
+    if ((uint8_t)(head - self.tail) > PIN_INTERRUPT_QUEUE_MASK)
+    {
+        ++self.dropped;
+        return;
+    }
+
+    event = &self.events[head & PIN_INTERRUPT_QUEUE_MASK];
+    event->tick = avr_ticks;
+    event->source = source;
+    event->changed = changed;
+    event->state = state;
+    RING_BARRIER();
+    self.head = head + 1;
+}
+
+uint8_t pin_interrupt_get_event(pin_interrupt_event_t *event)
+{
+    uint8_t tail = self.tail;
+
+    if (tail == self.head)
+    {
+        return 0;
+    }
+
+    *event = self.events[tail & PIN_INTERRUPT_QUEUE_MASK];
+    RING_BARRIER();
+    self.tail = tail + 1;
+    return 1;
+}
+
+uint16_t pin_interrupt_get_dropped(void)
+{
+    uint16_t dropped;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        dropped = self.dropped;
+    }
+    return dropped;
+}
+
+void pin_interrupt_enable_external(uint8_t number, pin_interrupt_sense_t sense)
+{
+    uint8_t shift = number ? ISC10 : ISC00;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        EICRA = (EICRA & ~(0x03 << shift)) | ((uint8_t) sense << shift);
+        // Clear a pending flag from before the sense was set
+        EIFR = (1 << (number ? INTF1 : INTF0));
+        EIMSK |= (1 << (number ? INT1 : INT0));
+    }
+}
+
+void pin_interrupt_disable_external(uint8_t number)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        EIMSK &= ~(1 << (number ? INT1 : INT0));
+    }
+}
+
+/*
+ * Returns the pin change group of the port of the pin, or
+ * PIN_INTERRUPT_GROUPS if the port has no pin change interrupt handled by
+ * this module. This includes the LED port, which is not resolved to the port
+ * it is configured as.
+ */
+static uint8_t pin_interrupt_group(uint16_t pin_id)
+{
+    uint8_t port = PIN_ID_PORT(pin_id);
+
+    if (port < PIN_PORT_B || port > PIN_PORT_D)
+    {
+        return PIN_INTERRUPT_GROUPS;
+    }
+#if defined(BITLOOM_UART_WAKE)
+    // The interrupt of port D is used by the UART HAL
+    if (port == PIN_PORT_D)
+    {
+        return PIN_INTERRUPT_GROUPS;
+    }
+#endif
+    return port - PIN_PORT_B;
+}
+
+uint8_t pin_interrupt_enable_change(uint16_t pin_id)
+{
+    uint8_t group = pin_interrupt_group(pin_id);
+    uint8_t mask = 1 << PIN_ID_BIT(pin_id);
+
+    if (group == PIN_INTERRUPT_GROUPS)
+    {
+        return 0;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint8_t state = *pin_interrupt_pins[group];
+
+        // Start from the current level of the new pin so that only later
+        // changes generate events
+        self.lastState[group] = (self.lastState[group] & ~mask) | (state & mask);
+        *pin_interrupt_masks[group] |= mask;
+        PCICR |= (1 << group);
+    }
+    return 1;
+}
+
+void pin_interrupt_disable_change(uint16_t pin_id)
+{
+    uint8_t group = pin_interrupt_group(pin_id);
+    uint8_t mask = 1 << PIN_ID_BIT(pin_id);
+
+    if (group == PIN_INTERRUPT_GROUPS)
+    {
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *pin_interrupt_masks[group] &= ~mask;
+        if (*pin_interrupt_masks[group] == 0)
+        {
+            PCICR &= ~(1 << group);
+        }
+    }
+}
+
+/*
+ * A pin change interrupt only tells that one of the enabled pins in the group
+ * has changed, so the pins are compared to the last known state.
+ */
+static inline void pin_interrupt_change(uint8_t group)
+{
+    uint8_t state = *pin_interrupt_pins[group];
+    uint8_t changed = (state ^ self.lastState[group]) & *pin_interrupt_masks[group];
+
+    self.lastState[group] = state;
+    if (changed)
+    {
+        pin_interrupt_push(PIN_PORT_B + group, changed, state);
+    }
+}
+
+ISR(INT0_vect)
+{
+    pin_interrupt_push(PIN_INTERRUPT_INT0, 1, (PIND >> PIND2) & 0x01);
+}
+
+ISR(INT1_vect)
+{
+    pin_interrupt_push(PIN_INTERRUPT_INT1, 1, (PIND >> PIND3) & 0x01);
+}
+
+ISR(PCINT0_vect)
+{
+    pin_interrupt_change(0);
+}
+
+ISR(PCINT1_vect)
+{
+    pin_interrupt_change(1);
+}
+
+// With BITLOOM_UART_WAKE the interrupt is used by the UART HAL
+#if !defined(BITLOOM_UART_WAKE)
+ISR(PCINT2_vect)
+{
+    pin_interrupt_change(2);
+}
+#endif
@@ -0,0 +1,138 @@
+/*
+ * Implementation of the CPU time profiler for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "avr_hal/profile.h"
+#include "avr_hal/timer.h"
+#include "avr_hal/uart_hal.h"
+
+typedef struct
+{
+    uint16_t start;
+    uint16_t count;
+    uint16_t min;
+    uint16_t max;
+    uint32_t total;
+} profile_slot_t;
+
+typedef struct
+{
+    profile_slot_t slots[PROFILE_SLOTS];
+    char line[48];
+    uint8_t next;
+    volatile uint8_t sending;
+} profile_t;
+static profile_t self;
+
+void profile_enter (uint8_t slot)
+{
+    self.slots[slot].start = (uint16_t) timer_now_us();
+}
+
+void profile_exit (uint8_t slot)
+{
+    profile_slot_t *p = &self.slots[slot];
+    uint16_t start = p->start;
+    uint16_t duration;
+
+    // The start of the tick interrupt is taken before the tick is counted
+    if (slot == PROFILE_SLOT_TIMER0)
+    {
+        start += (uint16_t) TICK_US;
+    }
+    duration = (uint16_t) timer_now_us() - start;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (p->count == 0 || duration < p->min)
+        {
+            p->min = duration;
+        }
+        if (duration > p->max)
+        {
+            p->max = duration;
+        }
+        p->total += duration;
+        ++p->count;
+    }
+}
+
+void profile_reset (void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset(self.slots, 0, sizeof(self.slots));
+    }
+}
+
+static char *profile_append (char *pos, uint32_t value)
+{
+    *pos++ = ',';
+    ultoa(value, pos, 10);
+    return pos + strlen(pos);
+}
+
+static void profile_sent (void)
+{
+    self.sending = 0;
+}
+
+uint8_t profile_dump (void)
+{
+    profile_slot_t slot;
+    uint8_t i;
+    char *pos;
+
+    // The line is in use until the previous one has been sent
+    if (self.sending)
+    {
+        return 1;
+    }
+
+    while (self.next < PROFILE_SLOTS)
+    {
+        i = self.next++;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            slot = self.slots[i];
+        }
+        if (slot.count == 0)
+        {
+            continue;
+        }
+
+        pos = self.line;
+        memcpy(pos, "PROF", 4);
+        pos = profile_append(pos + 4, i);
+        pos = profile_append(pos, slot.count);
+        pos = profile_append(pos, slot.min);
+        pos = profile_append(pos, slot.max);
+        pos = profile_append(pos, slot.total);
+        *pos++ = '\r';
+        *pos++ = '\n';
+
+        self.sending = 1;
+        if (uart_hal_send_buffer((const uint8_t *) self.line,
+                                 (uint8_t)(pos - self.line),
+                                 profile_sent) == uart_hal_busy)
+        {
+            // Another buffer is being sent, the slot is tried again at the
+            // next call
+            self.sending = 0;
+            self.next = i;
+        }
+        return 1;
+    }
+
+    self.next = 0;
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Implementation of the SPI master module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "avr_hal/pin_digital_io.h"
+#include "avr_hal/spi.h"
+
+#define SPI_DDR DDRB
+#define SPI_SS_BIT DDB2
+#define SPI_MOSI_BIT DDB3
+#define SPI_SCK_BIT DDB5
+
+#define SPI_IDLE_BYTE 0xff
+
+typedef struct
+{
+    spi_transfer_t *current;
+    spi_transfer_t *last;
+    uint16_t index;
+} spi_t;
+static spi_t self;
+
+void spi_init(spi_mode_t mode, spi_clock_t clock)
+{
+    SPI_DDR |= (1 << SPI_SS_BIT) | (1 << SPI_MOSI_BIT) | (1 << SPI_SCK_BIT);
+
+    // Datasheet page 140 and 141
+    SPCR = (1 << SPE) | (1 << MSTR) | ((uint8_t) mode << CPHA) |
+           ((uint8_t) clock & 0x03);
+    SPSR = ((uint8_t) clock & 0x04) ? (1 << SPI2X) : 0;
+}
+
+uint8_t spi_transfer(uint8_t data)
+{
+    SPDR = data;
+    while (!(SPSR & (1 << SPIF)));
+    return SPDR;
+}
+
+void spi_transfer_block(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+    uint8_t next;
+    uint8_t in;
+
+    if (length == 0)
+    {
+        return;
+    }
+
+    SPDR = tx ? *tx++ : SPI_IDLE_BYTE;
+    while (--length)
+    {
+        // Fetch the next byte while the current one is shifted out
+        next = tx ? *tx++ : SPI_IDLE_BYTE;
+        while (!(SPSR & (1 << SPIF)));
+
+        // The receive buffer is double buffered, so the next byte is started
+        // before the received one is read
+        SPDR = next;
+        in = SPDR;
+        if (rx)
+        {
+            *rx++ = in;
+        }
+    }
+
+    while (!(SPSR & (1 << SPIF)));
+    in = SPDR;
+    if (rx)
+    {
+        *rx = in;
+    }
+}
+
+static void spi_async_begin(spi_transfer_t *transfer)
+{
+    self.index = 0;
+    if (transfer->cs_pin != SPI_NO_CS)
+    {
+        pin_digital_io_write_low(transfer->cs_pin);
+    }
+    SPDR = transfer->tx_buffer ? transfer->tx_buffer[0] : SPI_IDLE_BYTE;
+}
+
+static void spi_async_finish(void)
+{
+    spi_transfer_t *transfer = self.current;
+
+    if (transfer->cs_pin != SPI_NO_CS)
+    {
+        pin_digital_io_write_high(transfer->cs_pin);
+    }
+
+    self.current = transfer->next;
+    if (self.current)
+    {
+        spi_async_begin(self.current);
+    }
+    else
+    {
+        self.last = 0;
+        SPCR &= ~(1 << SPIE);
+    }
+
+    transfer->next = 0;
+    transfer->pending = 0;
+
+    if (transfer->callback)
+    {
+        transfer->callback(transfer);
+    }
+}
+
+void spi_async_submit(spi_transfer_t *transfer)
+{
+    transfer->next = 0;
+    transfer->pending = 1;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (self.current)
+        {
+            self.last->next = transfer;
+            self.last = transfer;
+        }
+        else
+        {
+            self.current = transfer;
+            self.last = transfer;
+            SPCR |= (1 << SPIE);
+            spi_async_begin(transfer);
+        }
+    }
+}
+
+uint8_t spi_async_busy(void)
+{
+    return self.current != 0;
+}
+
+/*
+ * Serial transfer complete. The received byte is stored and the next byte
+ * is sent.
+ */
+ISR(SPI_STC_vect)
+{
+    spi_transfer_t *transfer = self.current;
+    uint8_t in = SPDR;
+
+    if (transfer->rx_buffer)
+    {
+        transfer->rx_buffer[self.index] = in;
+    }
+
+    if (++self.index < transfer->length)
+    {
+        SPDR = transfer->tx_buffer ? transfer->tx_buffer[self.index] : SPI_IDLE_BYTE;
+    }
+    else
+    {
+        spi_async_finish();
+    }
+}
@@ -0,0 +1,250 @@
+/*
+ * Implementation of the telemetry module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <string.h>
+#include <util/crc16.h>
+#include "avr_hal/telemetry.h"
+#include "avr_hal/timer.h"
+#include "avr_hal/uart_hal.h"
+
+#if TELEMETRY_BATCH_SIZE > 250
+#error "TELEMETRY_BATCH_SIZE must be at most 250"
+#endif
+
+#define TELEMETRY_TICK_SIZE 4
+#define TELEMETRY_HEADER_SIZE 4
+#define TELEMETRY_CRC_SIZE 2
+
+// The COBS encoding adds one byte per 254 bytes, plus the zero at the end
+#define TELEMETRY_FRAME_SIZE (TELEMETRY_BATCH_SIZE + TELEMETRY_BATCH_SIZE / 254 + 2)
+
+typedef struct
+{
+    uint8_t offset;
+    uint8_t priority;
+} telemetry_entry_t;
+
+typedef struct
+{
+    uint8_t batch[TELEMETRY_BATCH_SIZE];
+    uint8_t length;
+    Tick_t tick;
+    telemetry_entry_t entries[TELEMETRY_MAX_RECORDS];
+    uint8_t count;
+    uint8_t frame[TELEMETRY_FRAME_SIZE];
+    volatile uint8_t sending;
+    uint16_t dropped;
+} telemetry_t;
+static telemetry_t self;
+
+static void telemetry_sent(void)
+{
+    self.sending = 0;
+}
+
+/*
+ * COBS encoding, each run of non-zero bytes is preceded by the distance to
+ * the next zero (or the end), with at most 254 bytes per run.
+ */
+static uint8_t telemetry_encode(const uint8_t *data, uint8_t length, uint8_t *frame)
+{
+    uint8_t *code = frame;
+    uint8_t *out = frame + 1;
+    uint8_t run = 1;
+
+    while (length--)
+    {
+        if (*data)
+        {
+            *out++ = *data;
+            ++run;
+        }
+        if (!*data || run == 0xff)
+        {
+            *code = run;
+            code = out++;
+            run = 1;
+        }
+        ++data;
+    }
+    *code = run;
+    *out++ = 0;
+    return (uint8_t)(out - frame);
+}
+
+/*
+ * Remove record i from the batch.
+ */
+static void telemetry_remove(uint8_t i)
+{
+    uint8_t start = self.entries[i].offset;
+    uint8_t end = i + 1 < self.count ? self.entries[i + 1].offset : self.length;
+    uint8_t size = end - start;
+    uint8_t j;
+
+    memmove(&self.batch[start], &self.batch[end], self.length - end);
+    self.length -= size;
+    for (j = i; j + 1 < self.count; ++j)
+    {
+        self.entries[j].offset = self.entries[j + 1].offset - size;
+        self.entries[j].priority = self.entries[j + 1].priority;
+    }
+    --self.count;
+    ++self.dropped;
+}
+
+/*
+ * Drop the records with the lowest priority below priority until size bytes
+ * and one entry are free. Returns 0 if that isn't possible, in which case
+ * nothing is dropped.
+ */
+static uint8_t telemetry_make_room(uint8_t priority, uint8_t size)
+{
+    uint8_t free = TELEMETRY_BATCH_SIZE - TELEMETRY_CRC_SIZE - self.length;
+    uint8_t entries = TELEMETRY_MAX_RECORDS - self.count;
+    uint8_t lowest;
+    uint8_t i;
+
+    // First check that enough can be dropped
+    for (i = 0; i < self.count && (free < size || entries == 0); ++i)
+    {
+        if (self.entries[i].priority < priority)
+        {
+            uint8_t end = i + 1 < self.count ? self.entries[i + 1].offset : self.length;
+
+            free += end - self.entries[i].offset;
+            ++entries;
+        }
+    }
+    if (free < size || entries == 0)
+    {
+        return 0;
+    }
+
+    while (TELEMETRY_BATCH_SIZE - TELEMETRY_CRC_SIZE - self.length < size ||
+           self.count == TELEMETRY_MAX_RECORDS)
+    {
+        lowest = 0;
+        for (i = 1; i < self.count; ++i)
+        {
+            if (self.entries[i].priority < self.entries[lowest].priority)
+            {
+                lowest = i;
+            }
+        }
+        telemetry_remove(lowest);
+    }
+    return 1;
+}
+
+uint8_t telemetry_flush(void)
+{
+    uint16_t crc = 0;
+    uint8_t length;
+    uint8_t i;
+
+    if (self.count == 0)
+    {
+        return 1;
+    }
+    if (self.sending)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < self.length; ++i)
+    {
+        crc = _crc_xmodem_update(crc, self.batch[i]);
+    }
+    self.batch[self.length] = (uint8_t)(crc >> 8);
+    self.batch[self.length + 1] = (uint8_t) crc;
+
+    length = telemetry_encode(self.batch, self.length + TELEMETRY_CRC_SIZE, self.frame);
+
+    self.sending = 1;
+    if (uart_hal_send_buffer(self.frame, length, telemetry_sent) != uart_hal_ok)
+    {
+        // Another buffer is being transmitted by someone else, the batch is
+        // kept and encoded again at the next flush
+        self.sending = 0;
+        return 0;
+    }
+    self.count = 0;
+    self.length = 0;
+    return 1;
+}
+
+uint8_t telemetry_record(uint8_t type, uint8_t priority,
+                         const void *data, uint8_t length)
+{
+    uint16_t size = TELEMETRY_HEADER_SIZE + (uint16_t) length;
+    Tick_t now = timer_get_ticks();
+    uint32_t delta;
+    uint8_t *pos;
+
+    if (size > TELEMETRY_BATCH_SIZE - TELEMETRY_TICK_SIZE - TELEMETRY_CRC_SIZE)
+    {
+        ++self.dropped;
+        return 0;
+    }
+
+    // A new frame is started when the delta doesn't fit or the batch is full
+    delta = (Tick_t)(now - self.tick);
+    if (self.count &&
+        (delta > 0xffff || self.count == TELEMETRY_MAX_RECORDS ||
+         self.length + size > TELEMETRY_BATCH_SIZE - TELEMETRY_CRC_SIZE))
+    {
+        telemetry_flush();
+    }
+
+    // The delta of the record would be wrong if the batch couldn't be sent
+    if (self.count && delta > 0xffff)
+    {
+        ++self.dropped;
+        return 0;
+    }
+
+    if (self.count &&
+        (self.count == TELEMETRY_MAX_RECORDS ||
+         self.length + size > TELEMETRY_BATCH_SIZE - TELEMETRY_CRC_SIZE) &&
+        !telemetry_make_room(priority, (uint8_t) size))
+    {
+        ++self.dropped;
+        return 0;
+    }
+
+    if (self.count == 0)
+    {
+        uint32_t tick = now;
+
+        self.tick = now;
+        delta = 0;
+        memcpy(self.batch, &tick, TELEMETRY_TICK_SIZE);
+        self.length = TELEMETRY_TICK_SIZE;
+    }
+
+    self.entries[self.count].offset = self.length;
+    self.entries[self.count].priority = priority;
+    ++self.count;
+
+    pos = &self.batch[self.length];
+    *pos++ = type;
+    *pos++ = length;
+    *pos++ = (uint8_t) delta;
+    *pos++ = (uint8_t)(delta >> 8);
+    memcpy(pos, data, length);
+    self.length += (uint8_t) size;
+    return 1;
+}
+
+uint16_t telemetry_get_dropped(void)
+{
+    return self.dropped;
+}
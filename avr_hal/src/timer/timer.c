@@ -11,59 +11,449 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/power.h>
-#include <config/timer_config.h>
+#include <avr/sleep.h>
+#include <avr/wdt.h>
+#include <util/atomic.h>
+#include "avr_hal/profile.h"
+#include "avr_hal/timer.h"
+#include "avr_hal/trace.h"
+
+/*
+ * The ATtiny devices have one interrupt mask and flag register for all
+ * timers and other names for some of the registers and vectors.
+ */
+#if !defined(TIMSK0)
+#define TIMSK0 TIMSK
+#define TIFR0 TIFR
+#endif
+#if !defined(WDTCSR)
+#define WDTCSR WDTCR
+#endif
+#if !defined(TIMER0_COMPA_vect) && defined(TIM0_COMPA_vect)
+#define TIMER0_COMPA_vect TIM0_COMPA_vect
+#define TIMER0_COMPB_vect TIM0_COMPB_vect
+#endif
+
+#if defined(BITLOOM_NAKED_ISR) && (defined(BITLOOM_PROFILE) || defined(BITLOOM_TRACE))
+#error "BITLOOM_NAKED_ISR cannot be combined with BITLOOM_PROFILE or BITLOOM_TRACE"
+#endif
+
+/*
+ * Timer 0 counts TIMER0_COUNTS times per tick of TICK_US microseconds. The
+ * smallest prescaler that gives an exact tick period with at most 256
+ * counts is used (page 108 in the datasheet).
+ */
+#if (F_CPU * TICK_US) % 1000000ULL != 0
+#error "TICK_US is not a whole number of CPU cycles"
+#endif
+#define TIMER0_CYCLES (F_CPU * TICK_US / 1000000ULL)
+
+#if TIMER0_CYCLES <= 256
+#define TIMER0_PRESCALER 1
+#define TIMER0_CLOCK_SELECT (1 << CS00)
+#elif TIMER0_CYCLES % 8 == 0 && TIMER0_CYCLES / 8 <= 256
+#define TIMER0_PRESCALER 8
+#define TIMER0_CLOCK_SELECT (1 << CS01)
+#elif TIMER0_CYCLES % 64 == 0 && TIMER0_CYCLES / 64 <= 256
+#define TIMER0_PRESCALER 64
+#define TIMER0_CLOCK_SELECT ((1 << CS01) | (1 << CS00))
+#elif TIMER0_CYCLES % 256 == 0 && TIMER0_CYCLES / 256 <= 256
+#define TIMER0_PRESCALER 256
+#define TIMER0_CLOCK_SELECT (1 << CS02)
+#elif TIMER0_CYCLES % 1024 == 0 && TIMER0_CYCLES / 1024 <= 256
+#define TIMER0_PRESCALER 1024
+#define TIMER0_CLOCK_SELECT ((1 << CS02) | (1 << CS00))
+#else
+#error "TICK_US cannot be generated exactly by Timer 0 with this F_CPU"
+#endif
+
+#define TIMER0_COUNTS (TIMER0_CYCLES / TIMER0_PRESCALER)
+
+// The watchdog timeout is 2^(n+11) cycles of the 128 kHz oscillator, i.e.
+// 16 ms << n (page 55 in the datasheet), given here in ticks.
+#define TIMER_WDT_TICKS(n) ((16000UL << (n)) / TICK_US)
+#define TIMER_WDT_MAX_PRESCALER 9
+
+// The shortest watchdog timeout that is at least one tick. With a tick
+// longer than 16 ms the shorter timeouts would be counted as 0 ticks.
+#if TIMER_WDT_TICKS(0) > 0
+#define TIMER_WDT_MIN_PRESCALER 0
+#elif TIMER_WDT_TICKS(1) > 0
+#define TIMER_WDT_MIN_PRESCALER 1
+#elif TIMER_WDT_TICKS(2) > 0
+#define TIMER_WDT_MIN_PRESCALER 2
+#elif TIMER_WDT_TICKS(3) > 0
+#define TIMER_WDT_MIN_PRESCALER 3
+#elif TIMER_WDT_TICKS(4) > 0
+#define TIMER_WDT_MIN_PRESCALER 4
+#elif TIMER_WDT_TICKS(5) > 0
+#define TIMER_WDT_MIN_PRESCALER 5
+#else
+#error "TICK_US is too long for power down with the watchdog"
+#endif
+
+// The time slept in a watchdog period that is interrupted by another wakeup
+// is unknown. While such wakeups are possible the timeout is limited to
+// 16 ms << TIMER_WDT_WAKE_PRESCALER, which bounds the error per wakeup.
+#ifndef TIMER_WDT_WAKE_PRESCALER
+#define TIMER_WDT_WAKE_PRESCALER 2
+#endif
+#if TIMER_WDT_WAKE_PRESCALER < TIMER_WDT_MIN_PRESCALER
+#undef TIMER_WDT_WAKE_PRESCALER
+#define TIMER_WDT_WAKE_PRESCALER TIMER_WDT_MIN_PRESCALER
+#endif
+
+// The watchdog bits of the application that are restored after power down
+#define TIMER_WDT_APP_BITS ((1 << WDE) | (1 << WDP3) | (1 << WDP2) | \
+                            (1 << WDP1) | (1 << WDP0))
+
+static volatile uint8_t timer_wdt_expired;
 
 volatile Tick_t avr_ticks;
+timer_timeout_t avr_timeout;
 
 /*
  * Timer 0 is used to schedule the tasks.
  *
- * An interrupt is generated every ms and the scheduler timer tick function is
- * called.
+ * An interrupt is generated every TICK_US (1 ms by default) and the scheduler
+ * timer tick function is called.
  */
 void timer_init (void)
 {
-    // Set CPU clock frequency according to value in the Makefile
-#if F_CPU == 8000000
-    // Set CPU clock speed to 8MHz
+    // Disable the system clock prescaler unless running at the 1 MHz that
+    // the CKDIV8 fuse gives by default
+#if F_CPU != 1000000
     clock_prescale_set (clock_div_1);
 #endif
 
     // CTC mode (page 98, 104 and 106 in the datasheet).
     TCCR0A = (1 << WGM01);
 
-    // Set interrupt on compare match (page 109).
-    TIMSK0 = (1 << OCIE0A);
+    // Set interrupt on compare match (page 109). On ATtiny the register is
+    // shared with Timer 1.
+    TIMSK0 |= (1 << OCIE0A);
 
-    // Set prescaler and output compare register to generate a tick every ms
-    // Prescaler clk/8 and 125 time ticks @1 MHz -> 1ms
-    // Prescaler clk/64 and 125 time ticks @8 MHz -> 1ms
-    // (Page 108 in the datasheet.)
-    OCR0A = 124;
+    // Set prescaler and output compare register to generate a tick every
+    // TICK_US, e.g. clk/64 and 125 time ticks @8 MHz -> 1ms
+    OCR0A = (uint8_t)(TIMER0_COUNTS - 1);
 
-#if F_CPU == 1000000
-    TCCR0B = (1 << CS01);
-#elif F_CPU == 8000000
-    TCCR0B = (1 << CS01) | (1 << CS00);
-#endif
+    // The timeout interrupt occurs in the middle of the tick, away from the
+    // tick interrupt
+    OCR0B = (uint8_t)(TIMER0_COUNTS / 2);
+
+    TCCR0B = TIMER0_CLOCK_SELECT;
 
     avr_ticks = 0;
 }
 
 void timer_start (void)
 {
+    TCCR0B = TIMER0_CLOCK_SELECT;
     sei();
 }
 
+/*
+ * Stop the timer clock. The tick counter and the timer value are kept.
+ */
 void timer_stop (void)
 {
+    TCCR0B = 0;
+}
+
+/*
+ * Power down is only used if no transmission is ongoing in the USART (or the
+ * software UART on ATtiny), the TWI engine and the ADC since their clocks are
+ * stopped in power down mode.
+ * Auto triggered ADC sampling, queued EEPROM writes and an armed timeout
+ * also prevent power down.
+ */
+static uint8_t timer_power_down_is_safe (void)
+{
+#if defined(UCSR0B)
+    // UDRE0 is set when the last byte has been moved to the shift register,
+    // TXCIE0 is enabled until it has been sent
+    if ((UCSR0B & ((1 << UDRIE0) | (1 << TXCIE0))) || !(UCSR0A & (1 << UDRE0)))
+    {
+        return 0;
+    }
+#else
+    // The software UART uses the Timer 1 compare interrupt during a frame
+    if (TIMSK & (1 << OCIE1A))
+    {
+        return 0;
+    }
+#endif
+#if defined(TWCR)
+    if (TWCR & (1 << TWIE))
+    {
+        return 0;
+    }
+#endif
+    if (ADCSRA & ((1 << ADSC) | (1 << ADATE)))
+    {
+        return 0;
+    }
+    // The EEPROM ready interrupt doesn't wake up the MCU from power down
+    if (EECR & (1 << EERIE))
+    {
+        return 0;
+    }
+    // Timer 0 is stopped in power down, so the timeout would not expire
+    if (TIMSK0 & (1 << OCIE0B))
+    {
+        return 0;
+    }
+    return 1;
 }
 
+/*
+ * Power down until the watchdog expires or another interrupt wakes up the
+ * MCU. A reset watchdog that the application has enabled is suspended while
+ * sleeping and restored afterwards.
+ *
+ * The safety check is repeated with the interrupts disabled until the MCU
+ * sleeps, since an interrupt after the check in timer_idle may have started
+ * an operation, e.g. a received byte that armed the timeout.
+ *
+ * Returns 1 if the watchdog period has expired, and 0 if the MCU was woken
+ * up by another interrupt or power down is no longer safe.
+ */
+/*
+ * Returns 1 if a pin change or external interrupt is enabled, i.e. if the
+ * MCU may be woken up from power down by something else than the watchdog.
+ */
+static uint8_t timer_wake_sources_enabled (void)
+{
+#if defined(PCICR)
+    return PCICR || (EIMSK & ((1 << INT1) | (1 << INT0)));
+#else
+    return (GIMSK & ((1 << INT0) | (1 << PCIE))) ? 1 : 0;
+#endif
+}
+
+static uint8_t timer_wdt_sleep (uint8_t prescaler)
+{
+    uint8_t wdp = (prescaler & 0x07) | ((prescaler & 0x08) ? (1 << WDP3) : 0);
+    uint8_t watchdog;
+
+    cli();
+    if (!timer_power_down_is_safe())
+    {
+        sei();
+        return 0;
+    }
+
+    timer_wdt_expired = 0;
+    watchdog = WDTCSR & TIMER_WDT_APP_BITS;
+    wdt_reset();
+    // Timed sequence to enable the watchdog in interrupt mode (page 51)
+    MCUSR &= ~(1 << WDRF);
+    WDTCSR = (1 << WDCE) | (1 << WDE);
+    WDTCSR = (1 << WDIE) | wdp;
+
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    // The instruction after sei is executed before any interrupt, so the
+    // wakeup cannot be missed
+    sei();
+    sleep_cpu();
+    sleep_disable();
+
+    // Timed sequence to restore the watchdog, started from the beginning of
+    // its period
+    cli();
+    wdt_reset();
+    WDTCSR = (1 << WDCE) | (1 << WDE);
+    WDTCSR = watchdog;
+    sei();
+    return timer_wdt_expired;
+}
+
+Tick_t timer_idle (Tick_t idle_ticks, uint8_t allow_power_down)
+{
+    Tick_t slept = 0;
+    int8_t prescaler;
+
+    if (!allow_power_down ||
+        idle_ticks < TIMER_WDT_TICKS(TIMER_WDT_MIN_PRESCALER) ||
+        !timer_power_down_is_safe())
+    {
+        // Sleep until the next interrupt, at the latest the next tick
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        sleep_mode();
+        return 0;
+    }
+
+    // The timer is stopped while the MCU is powered down and the watchdog is
+    // used to wake it up. The longest watchdog timeouts that fit are used
+    // until the remaining time is shorter than the shortest timeout.
+    timer_stop();
+    prescaler = timer_wake_sources_enabled() ? TIMER_WDT_WAKE_PRESCALER :
+                                               TIMER_WDT_MAX_PRESCALER;
+    while (prescaler >= TIMER_WDT_MIN_PRESCALER)
+    {
+        if ((Tick_t)(idle_ticks - slept) < TIMER_WDT_TICKS(prescaler))
+        {
+            --prescaler;
+        }
+        else if (timer_wdt_sleep(prescaler))
+        {
+            slept += TIMER_WDT_TICKS(prescaler);
+        }
+        else
+        {
+            // Woken up by another interrupt, or an interrupt has started an
+            // operation that prevents power down. The time slept in this
+            // period is unknown and is not counted.
+            break;
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        avr_ticks += slept;
+    }
+    timer_start();
+    return slept;
+}
+
+uint32_t timer_now_us (void)
+{
+    Tick_t ticks;
+    uint8_t counts;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ticks = avr_ticks;
+        counts = TCNT0;
+
+        // If the compare match has occurred but the interrupt hasn't been
+        // served yet, the counter has restarted and the tick is missing.
+        // TCNT0 is read again since it may have restarted after the first
+        // read.
+        if (TIFR0 & (1 << OCF0A))
+        {
+            counts = TCNT0;
+            ++ticks;
+        }
+    }
+
+#if TICK_US % TIMER0_COUNTS == 0
+    return (uint32_t) ticks * TICK_US +
+           (uint16_t) counts * (uint16_t)(TICK_US / TIMER0_COUNTS);
+#else
+    return (uint32_t) ticks * TICK_US +
+           (uint16_t)((uint32_t) counts * TICK_US / (uint16_t) TIMER0_COUNTS);
+#endif
+}
+
+void timer_timeout_init (uint8_t ticks, timer_timeout_callback_t callback)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        avr_timeout.ticks = ticks;
+        avr_timeout.callback = callback;
+    }
+}
+
+void timer_timeout_start (void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        timer_timeout_retrigger();
+    }
+}
+
+void timer_timeout_cancel (void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        TIMSK0 &= ~(1 << OCIE0B);
+    }
+}
+
+/*
+ * The timeout counts down once per tick while it is armed. The interrupt is
+ * disabled when it expires, so that it doesn't wake up the MCU every tick.
+ */
+ISR(TIMER0_COMPB_vect)
+{
+    if (--avr_timeout.remaining == 0)
+    {
+        TIMSK0 &= ~(1 << OCIE0B);
+        if (avr_timeout.callback)
+        {
+            avr_timeout.callback();
+        }
+    }
+}
+
+/*
+ * The watchdog interrupt is only used to wake up from power down.
+ */
+ISR(WDT_vect)
+{
+    timer_wdt_expired = 1;
+}
+
+#if defined(BITLOOM_NAKED_ISR)
+/*
+ * Interrupt routine to update the ticks, without the prologue and epilogue
+ * of the compiler. Only r24 and SREG are saved and the higher bytes are
+ * only touched when the lower byte wraps around. Tick_t may be 1, 2 or 4
+ * bytes.
+ *
+ * The common case takes 21 cycles including reti (one 2-cycle step per
+ * extra byte when a byte wraps around), compared to about 55 cycles for the
+ * C version with a 32-bit Tick_t. The interrupt response and the jump in the
+ * vector table add 7 cycles to both.
+ */
+ISR(TIMER0_COMPA_vect, ISR_NAKED)
+{
+    __asm__ __volatile__ (
+        "push r24"                  "\n\t"
+        "in r24, __SREG__"          "\n\t"
+        "push r24"                  "\n\t"
+        "lds r24, %[ticks]"         "\n\t"
+        "inc r24"                   "\n\t"
+        "sts %[ticks], r24"         "\n\t"
+        ".if %[size] > 1"           "\n\t"
+        "brne 1f"                   "\n\t"
+        "lds r24, %[ticks]+1"       "\n\t"
+        "inc r24"                   "\n\t"
+        "sts %[ticks]+1, r24"       "\n\t"
+        ".endif"                    "\n\t"
+        ".if %[size] > 2"           "\n\t"
+        "brne 1f"                   "\n\t"
+        "lds r24, %[ticks]+2"       "\n\t"
+        "inc r24"                   "\n\t"
+        "sts %[ticks]+2, r24"       "\n\t"
+        "brne 1f"                   "\n\t"
+        "lds r24, %[ticks]+3"       "\n\t"
+        "inc r24"                   "\n\t"
+        "sts %[ticks]+3, r24"       "\n\t"
+        ".endif"                    "\n"
+        "1:"                        "\n\t"
+        "pop r24"                   "\n\t"
+        "out __SREG__, r24"         "\n\t"
+        "pop r24"                   "\n\t"
+        "reti"                      "\n\t"
+        :
+        : [ticks] "i" (&avr_ticks),
+          [size] "n" (sizeof(Tick_t))
+    );
+}
+#else
 /*
  * Interrupt routine to update the ticks.
  */
 ISR(TIMER0_COMPA_vect)
 {
+    trace_enter(TRACE_CH_TIMER0);
+    PROFILE_ENTER(PROFILE_SLOT_TIMER0);
     ++avr_ticks;
+    PROFILE_EXIT(PROFILE_SLOT_TIMER0);
+    trace_exit(TRACE_CH_TIMER0);
 }
+#endif
 
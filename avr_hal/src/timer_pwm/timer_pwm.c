@@ -0,0 +1,194 @@
+/*
+ * Implementation of the hardware PWM and input capture module for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "avr_hal/timer_pwm.h"
+
+typedef struct
+{
+    uint16_t edge;
+    uint16_t high;
+    uint16_t low;
+    uint8_t started;
+    volatile uint8_t ready;
+} timer_capture_t;
+static timer_capture_t self;
+
+void timer_pwm_init_timer1(timer_pwm_mode_t mode, timer1_clock_t clock,
+                           uint16_t top)
+{
+    TIMSK1 = 0;
+    TCCR1B = 0;
+    TCCR1A &= (1 << COM1A1) | (1 << COM1A0) | (1 << COM1B1) | (1 << COM1B0);
+
+    // Mode 14 (fast) or mode 10 (phase correct) with ICR1 as TOP (page 136)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ICR1 = top;
+        TCNT1 = 0;
+    }
+    TCCR1A |= (1 << WGM11);
+    TCCR1B = (1 << WGM13) | ((mode == timer_pwm_fast) ? (1 << WGM12) : 0) |
+             (uint8_t) clock;
+}
+
+void timer_pwm_init_timer2(timer_pwm_mode_t mode, timer2_clock_t clock)
+{
+    TIMSK2 = 0;
+    TCCR2B = 0;
+    TCNT2 = 0;
+
+    // Mode 3 (fast) or mode 1 (phase correct) with TOP 0xff (page 161)
+    TCCR2A = (TCCR2A & ((1 << COM2A1) | (1 << COM2A0) |
+                        (1 << COM2B1) | (1 << COM2B0))) |
+             ((mode == timer_pwm_fast) ? ((1 << WGM21) | (1 << WGM20)) :
+                                         (1 << WGM20));
+    TCCR2B = (uint8_t) clock;
+}
+
+void timer_pwm_enable(timer_pwm_output_t output, uint8_t inverted)
+{
+    // Clear on compare match when counting up, or set when inverted
+    // (page 134 and 159)
+    uint8_t com = inverted ? 0x03 : 0x02;
+
+    switch (output)
+    {
+        case timer_pwm_oc1a:
+            DDRB |= (1 << DDB1);
+            TCCR1A = (TCCR1A & ~(0x03 << COM1A0)) | (com << COM1A0);
+            break;
+        case timer_pwm_oc1b:
+            DDRB |= (1 << DDB2);
+            TCCR1A = (TCCR1A & ~(0x03 << COM1B0)) | (com << COM1B0);
+            break;
+        case timer_pwm_oc2a:
+            DDRB |= (1 << DDB3);
+            TCCR2A = (TCCR2A & ~(0x03 << COM2A0)) | (com << COM2A0);
+            break;
+        case timer_pwm_oc2b:
+            DDRD |= (1 << DDD3);
+            TCCR2A = (TCCR2A & ~(0x03 << COM2B0)) | (com << COM2B0);
+            break;
+    }
+}
+
+void timer_pwm_disable(timer_pwm_output_t output)
+{
+    switch (output)
+    {
+        case timer_pwm_oc1a:
+            TCCR1A &= ~(0x03 << COM1A0);
+            break;
+        case timer_pwm_oc1b:
+            TCCR1A &= ~(0x03 << COM1B0);
+            break;
+        case timer_pwm_oc2a:
+            TCCR2A &= ~(0x03 << COM2A0);
+            break;
+        case timer_pwm_oc2b:
+            TCCR2A &= ~(0x03 << COM2B0);
+            break;
+    }
+}
+
+void timer_pwm_set_duty(timer_pwm_output_t output, uint16_t duty)
+{
+    switch (output)
+    {
+        case timer_pwm_oc1a:
+            // The 16-bit registers share the TEMP register, which must not
+            // be used by an interrupt in between (page 114)
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                OCR1A = duty;
+            }
+            break;
+        case timer_pwm_oc1b:
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                OCR1B = duty;
+            }
+            break;
+        case timer_pwm_oc2a:
+            OCR2A = (uint8_t) duty;
+            break;
+        case timer_pwm_oc2b:
+            OCR2B = (uint8_t) duty;
+            break;
+    }
+}
+
+void timer_capture_start(timer1_clock_t clock, uint8_t noise_canceler)
+{
+    TIMSK1 = 0;
+    TCCR1B = 0;
+    TCCR1A = 0;
+    self.started = 0;
+    self.ready = 0;
+
+    // Normal mode, capture on the rising edge first (page 117)
+    DDRB &= ~(1 << DDB0);
+    TCCR1B = (noise_canceler ? (1 << ICNC1) : 0) | (1 << ICES1) |
+             (uint8_t) clock;
+    TIFR1 = (1 << ICF1);
+    TIMSK1 = (1 << ICIE1);
+}
+
+void timer_capture_stop(void)
+{
+    TIMSK1 = 0;
+    TCCR1B = 0;
+}
+
+uint8_t timer_capture_read(uint16_t *high, uint16_t *low)
+{
+    uint8_t ready;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *high = self.high;
+        *low = self.low;
+        ready = self.ready;
+        self.ready = 0;
+    }
+    return ready;
+}
+
+/*
+ * Input capture. The captured edge is toggled in each interrupt and the
+ * flag is cleared after the change, as required by the datasheet (page 118).
+ */
+ISR(TIMER1_CAPT_vect)
+{
+    uint16_t now = ICR1;
+    uint8_t rising = TCCR1B & (1 << ICES1);
+
+    TCCR1B ^= (1 << ICES1);
+    TIFR1 = (1 << ICF1);
+
+    if (!self.started)
+    {
+        // The first edge only starts the measurement
+        self.started = 1;
+    }
+    else if (rising)
+    {
+        self.low = now - self.edge;
+    }
+    else
+    {
+        self.high = now - self.edge;
+        self.ready = 1;
+    }
+    self.edge = now;
+}
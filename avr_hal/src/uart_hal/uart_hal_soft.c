@@ -0,0 +1,284 @@
+/*
+ * Implementation of the UART module for AVR devices without a USART (e.g.
+ * the ATtiny25/45/85), as a half-duplex software UART.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <string.h>
+#include <util/atomic.h>
+#include "avr_hal/uart_hal.h"
+
+#if !defined(TCCR1) || !defined(CTC1)
+#error "The software UART needs the 8-bit Timer 1 of the ATtiny25/45/85"
+#endif
+
+#if !defined(TIMER1_COMPA_vect) && defined(TIM1_COMPA_vect)
+#define TIMER1_COMPA_vect TIM1_COMPA_vect
+#endif
+
+#ifndef UART_SOFT_PORT
+#define UART_SOFT_PORT PORTB
+#define UART_SOFT_DDR DDRB
+#define UART_SOFT_PIN PINB
+#define UART_SOFT_TX_BIT PORTB3
+#define UART_SOFT_RX_BIT PORTB4
+#endif
+
+/*
+ * Timer 1 runs in CTC mode with one compare match per bit. The smallest
+ * prescaler that gives at most 256 counts per bit is used (ATtiny85
+ * datasheet page 89).
+ */
+#define UART_SOFT_CYCLES ((F_CPU + BAUD / 2) / BAUD)
+
+#if UART_SOFT_CYCLES <= 256
+#define UART_SOFT_PRESCALER 1
+#define UART_SOFT_CLOCK_SELECT 1
+#elif UART_SOFT_CYCLES <= 2 * 256
+#define UART_SOFT_PRESCALER 2
+#define UART_SOFT_CLOCK_SELECT 2
+#elif UART_SOFT_CYCLES <= 4 * 256
+#define UART_SOFT_PRESCALER 4
+#define UART_SOFT_CLOCK_SELECT 3
+#elif UART_SOFT_CYCLES <= 8 * 256
+#define UART_SOFT_PRESCALER 8
+#define UART_SOFT_CLOCK_SELECT 4
+#elif UART_SOFT_CYCLES <= 16 * 256
+#define UART_SOFT_PRESCALER 16
+#define UART_SOFT_CLOCK_SELECT 5
+#elif UART_SOFT_CYCLES <= 32 * 256
+#define UART_SOFT_PRESCALER 32
+#define UART_SOFT_CLOCK_SELECT 6
+#elif UART_SOFT_CYCLES <= 64 * 256
+#define UART_SOFT_PRESCALER 64
+#define UART_SOFT_CLOCK_SELECT 7
+#else
+#error "BAUD is too low for the software UART"
+#endif
+
+#define UART_SOFT_TOP ((UART_SOFT_CYCLES + UART_SOFT_PRESCALER / 2) / UART_SOFT_PRESCALER - 1)
+
+// The bit time must be within 2% of the baud rate
+#if ((UART_SOFT_TOP + 1) * UART_SOFT_PRESCALER * 50 > UART_SOFT_CYCLES * 51) || \
+    ((UART_SOFT_TOP + 1) * UART_SOFT_PRESCALER * 50 < UART_SOFT_CYCLES * 49)
+#error "BAUD cannot be generated by the software UART with this F_CPU"
+#endif
+
+#if UART_SOFT_TOP < 16
+#error "BAUD is too high for the software UART"
+#endif
+
+#define UART_SOFT_STOP_BIT 9
+
+typedef enum
+{
+    uart_soft_idle,
+    uart_soft_receiving,
+    uart_soft_transmitting
+} uart_soft_state_t;
+
+typedef struct
+{
+    bytebuffer_t *inBuffer;
+    bytebuffer_t *outBuffer;
+    volatile uart_soft_state_t state;
+    uint8_t bit;
+    uint8_t shift;
+    uart_hal_stats_t stats;
+} uart_hal_t;
+static uart_hal_t self;
+
+static void uart_soft_timer_start(uint8_t count)
+{
+    TCNT1 = count;
+    TIFR = (1 << OCF1A);
+    TIMSK |= (1 << OCIE1A);
+    TCCR1 = (1 << CTC1) | UART_SOFT_CLOCK_SELECT;
+}
+
+static void uart_soft_timer_stop(void)
+{
+    TCCR1 = 0;
+    TIMSK &= ~(1 << OCIE1A);
+}
+
+/*
+ * Send the start bit of the next byte in the out buffer, or wait for the
+ * start bit of a received byte if there is nothing to send.
+ */
+static void uart_soft_next(void)
+{
+    if (!bytebuffer_isEmpty(self.outBuffer))
+    {
+        self.state = uart_soft_transmitting;
+        self.shift = bytebuffer_read(self.outBuffer);
+        self.bit = 0;
+        UART_SOFT_PORT &= ~(1 << UART_SOFT_TX_BIT);
+        uart_soft_timer_start(0);
+    }
+    else
+    {
+        self.state = uart_soft_idle;
+        uart_soft_timer_stop();
+        GIFR = (1 << PCIF);
+        PCMSK |= (1 << UART_SOFT_RX_BIT);
+    }
+}
+
+void uart_hal_init(bytebuffer_t *inBuffer, bytebuffer_t *outBuffer)
+{
+    self.inBuffer = inBuffer;
+    self.outBuffer = outBuffer;
+
+    OCR1A = UART_SOFT_TOP;
+    OCR1C = UART_SOFT_TOP;
+
+    // TX idles high, RX with pull-up
+    UART_SOFT_PORT |= (1 << UART_SOFT_TX_BIT) | (1 << UART_SOFT_RX_BIT);
+    UART_SOFT_DDR |= (1 << UART_SOFT_TX_BIT);
+    UART_SOFT_DDR &= ~(1 << UART_SOFT_RX_BIT);
+
+    // The start bit is detected by the pin change interrupt
+    GIMSK |= (1 << PCIE);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uart_soft_next();
+    }
+}
+
+void uart_hal_send(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        // Otherwise the transmission is started when the current frame is
+        // completed
+        if (self.state == uart_soft_idle)
+        {
+            PCMSK &= ~(1 << UART_SOFT_RX_BIT);
+            uart_soft_next();
+        }
+    }
+}
+
+void uart_hal_get_stats(uart_hal_stats_t *stats)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *stats = self.stats;
+    }
+}
+
+void uart_hal_reset_stats(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset(&self.stats, 0, sizeof(self.stats));
+    }
+}
+
+/*
+ * Start bit. The first compare match is half a bit later, in the middle of
+ * the start bit, and the following ones in the middle of each bit.
+ */
+ISR(PCINT0_vect)
+{
+    if (self.state != uart_soft_idle ||
+        (UART_SOFT_PIN & (1 << UART_SOFT_RX_BIT)))
+    {
+        return;
+    }
+
+    // The line isn't watched while the frame is received or transmitted
+    PCMSK &= ~(1 << UART_SOFT_RX_BIT);
+    self.state = uart_soft_receiving;
+    self.bit = 0;
+    uart_soft_timer_start(UART_SOFT_TOP / 2);
+}
+
+static inline void uart_soft_receive_bit(void)
+{
+    uint8_t level = UART_SOFT_PIN & (1 << UART_SOFT_RX_BIT);
+
+    if (self.bit == 0)
+    {
+        // A start bit that is gone in the middle was a glitch
+        if (level)
+        {
+            uart_soft_next();
+            return;
+        }
+    }
+    else if (self.bit < UART_SOFT_STOP_BIT)
+    {
+        self.shift >>= 1;
+        if (level)
+        {
+            self.shift |= 0x80;
+        }
+    }
+    else
+    {
+        ++self.stats.received;
+        if (!level)
+        {
+            ++self.stats.framingError;
+        }
+        else if (bytebuffer_isFull(self.inBuffer))
+        {
+            ++self.stats.droppedFull;
+        }
+        else
+        {
+            bytebuffer_write(self.inBuffer, self.shift);
+        }
+        uart_soft_next();
+        return;
+    }
+    ++self.bit;
+}
+
+static inline void uart_soft_transmit_bit(void)
+{
+    if (self.bit < 8)
+    {
+        if (self.shift & 0x01)
+        {
+            UART_SOFT_PORT |= (1 << UART_SOFT_TX_BIT);
+        }
+        else
+        {
+            UART_SOFT_PORT &= ~(1 << UART_SOFT_TX_BIT);
+        }
+        self.shift >>= 1;
+    }
+    else if (self.bit == 8)
+    {
+        UART_SOFT_PORT |= (1 << UART_SOFT_TX_BIT);
+    }
+    else
+    {
+        // The stop bit has been sent
+        uart_soft_next();
+        return;
+    }
+    ++self.bit;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    if (self.state == uart_soft_receiving)
+    {
+        uart_soft_receive_bit();
+    }
+    else
+    {
+        uart_soft_transmit_bit();
+    }
+}
@@ -0,0 +1,218 @@
+/*
+ * Implementation of the SPI master on the USART (MSPIM) for AVR.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include "avr_hal/pin_digital_io.h"
+#include "avr_hal/uart_spi.h"
+
+#define UART_SPI_IDLE_BYTE 0xff
+
+// UCSR0B when no transfer is ongoing
+#define UART_SPI_IDLE ((1 << RXEN0) | (1 << TXEN0))
+
+typedef struct
+{
+    spi_transfer_t *current;
+    spi_transfer_t *last;
+    uint16_t txIndex;
+    uint16_t rxIndex;
+} uart_spi_t;
+static uart_spi_t self;
+
+void uart_spi_init(spi_mode_t mode, uint16_t ubrr)
+{
+    // Initialization sequence on page 206 in the datasheet. The baud rate
+    // must be zero while the transmitter is enabled.
+    UBRR0 = 0;
+    DDRD |= (1 << DDD4);
+    UCSR0C = (1 << UMSEL01) | (1 << UMSEL00) |
+             (((uint8_t) mode & 0x01) ? (1 << UCPHA0) : 0) |
+             (((uint8_t) mode & 0x02) ? (1 << UCPOL0) : 0);
+    UCSR0B = UART_SPI_IDLE;
+    UBRR0 = ubrr;
+}
+
+static inline uint8_t uart_spi_tx_byte(const uint8_t *tx, uint16_t index)
+{
+    return tx ? tx[index] : UART_SPI_IDLE_BYTE;
+}
+
+/*
+ * Load a byte for a transfer without an rx buffer, which completes on the
+ * transmit complete flag. A gap between the bytes sets the flag in the
+ * middle of the transfer, so it is cleared (by writing a one to it) after
+ * each byte has been loaded.
+ */
+static inline void uart_spi_load(uint8_t byte)
+{
+    UDR0 = byte;
+    UCSR0A = (1 << TXC0);
+}
+
+void uart_spi_transfer_block(const uint8_t *tx, uint8_t *rx, uint16_t length)
+{
+    uint16_t txIndex = 0;
+    uint16_t rxIndex = 0;
+
+    if (rx == 0)
+    {
+        while (txIndex < length)
+        {
+            while (!(UCSR0A & (1 << UDRE0)));
+            uart_spi_load(uart_spi_tx_byte(tx, txIndex++));
+        }
+        while (!(UCSR0A & (1 << TXC0)));
+
+        // Discard what was received during the transfer
+        while (UCSR0A & (1 << RXC0))
+        {
+            (void) UDR0;
+        }
+        return;
+    }
+
+    // The receive buffer holds two bytes, so at most two are kept in flight
+    while (rxIndex < length)
+    {
+        if (txIndex < length && (uint16_t)(txIndex - rxIndex) < 2 &&
+            (UCSR0A & (1 << UDRE0)))
+        {
+            UDR0 = uart_spi_tx_byte(tx, txIndex++);
+        }
+        if (UCSR0A & (1 << RXC0))
+        {
+            rx[rxIndex++] = UDR0;
+        }
+    }
+}
+
+static void uart_spi_begin(spi_transfer_t *transfer)
+{
+    self.txIndex = 0;
+    self.rxIndex = 0;
+
+    if (transfer->cs_pin != SPI_NO_CS)
+    {
+        pin_digital_io_write_low(transfer->cs_pin);
+    }
+
+    if (transfer->rx_buffer)
+    {
+        UCSR0B = UART_SPI_IDLE | (1 << RXCIE0);
+        UDR0 = uart_spi_tx_byte(transfer->tx_buffer, self.txIndex++);
+        if (self.txIndex < transfer->length)
+        {
+            // The first byte moves to the shift register almost at once
+            while (!(UCSR0A & (1 << UDRE0)));
+            UDR0 = uart_spi_tx_byte(transfer->tx_buffer, self.txIndex++);
+        }
+    }
+    else
+    {
+        UCSR0B = (1 << TXEN0) | (1 << UDRIE0);
+    }
+}
+
+static void uart_spi_finish(void)
+{
+    spi_transfer_t *transfer = self.current;
+
+    if (transfer->cs_pin != SPI_NO_CS)
+    {
+        pin_digital_io_write_high(transfer->cs_pin);
+    }
+
+    UCSR0B = UART_SPI_IDLE;
+    self.current = transfer->next;
+    if (self.current)
+    {
+        uart_spi_begin(self.current);
+    }
+    else
+    {
+        self.last = 0;
+    }
+
+    transfer->next = 0;
+    transfer->pending = 0;
+
+    if (transfer->callback)
+    {
+        transfer->callback(transfer);
+    }
+}
+
+void uart_spi_async_submit(spi_transfer_t *transfer)
+{
+    transfer->next = 0;
+    transfer->pending = 1;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (self.current)
+        {
+            self.last->next = transfer;
+            self.last = transfer;
+        }
+        else
+        {
+            self.current = transfer;
+            self.last = transfer;
+            uart_spi_begin(transfer);
+        }
+    }
+}
+
+uint8_t uart_spi_async_busy(void)
+{
+    return self.current != 0;
+}
+
+/*
+ * Transfers with an rx buffer. Each received byte makes room for a new one
+ * in the receive buffer.
+ */
+ISR(USART_RX_vect)
+{
+    spi_transfer_t *transfer = self.current;
+
+    transfer->rx_buffer[self.rxIndex++] = UDR0;
+    if (self.txIndex < transfer->length)
+    {
+        UDR0 = uart_spi_tx_byte(transfer->tx_buffer, self.txIndex++);
+    }
+    else if (self.rxIndex == transfer->length)
+    {
+        uart_spi_finish();
+    }
+}
+
+/*
+ * Transfers without an rx buffer. The next byte is written as soon as the
+ * data register is empty and the transfer completes when the last byte has
+ * been shifted out.
+ */
+ISR(USART_UDRE_vect)
+{
+    spi_transfer_t *transfer = self.current;
+
+    uart_spi_load(uart_spi_tx_byte(transfer->tx_buffer, self.txIndex++));
+    if (self.txIndex == transfer->length)
+    {
+        UCSR0B = (1 << TXEN0) | (1 << TXCIE0);
+    }
+}
+
+ISR(USART_TX_vect)
+{
+    uart_spi_finish();
+}
@@ -0,0 +1,241 @@
+/*
+ * Cycle count benchmark of the HAL hot paths.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal/timer.h"
+#include "avr_hal/i2c.h"
+#include "avr_hal/pin_digital_io.h"
+#include "avr_hal/ring.h"
+#include "avr_hal/timer.h"
+#include "avr_hal/uart_hal.h"
+
+#if !defined(UART_HAL_USE_RING)
+#error "The benchmark uses the UART HAL in ring mode"
+#endif
+
+#if defined(BENCH_SIMAVR)
+/*
+ * Information for simavr, which is stored in the ELF file. The simulator
+ * writes the UART, TWI and port registers to a VCD trace.
+ */
+#include <avr/avr_mcu_section.h>
+
+AVR_MCU(F_CPU, BENCH_SIMAVR_MCU);
+AVR_MCU_VCD_FILE("bench.vcd", 1000);
+
+const struct avr_mmcu_vcd_trace_t bench_trace[] _MMCU_ =
+{
+    { AVR_MCU_VCD_SYMBOL("UDR0"), .what = (void *) &UDR0, },
+    { AVR_MCU_VCD_SYMBOL("TWDR"), .what = (void *) &TWDR, },
+    { AVR_MCU_VCD_SYMBOL("TWCR"), .what = (void *) &TWCR, },
+    { AVR_MCU_VCD_SYMBOL("PORTB"), .what = (void *) &PORTB, },
+    { AVR_MCU_VCD_SYMBOL("PORTC"), .what = (void *) &PORTC, },
+    { AVR_MCU_VCD_SYMBOL("PORTD"), .what = (void *) &PORTD, },
+};
+#endif
+
+/*
+ * Timer 1 runs at clk/1 and each measurement is repeated BENCH_RUNS times.
+ * The lowest count is reported, which filters out the runs that were hit
+ * by an interrupt, minus the count of an empty measurement. Measurements of
+ * 65535 cycles or more are reported as 65535.
+ *
+ * One line is written to the UART per measurement:
+ *
+ * BENCH,<name>,<cycles>
+ */
+#define BENCH_RUNS 8
+#define BENCH_OVERFLOW 0xffff
+#define BENCH_PIN PIN_ID(PIN_PORT_B, 0)
+#define BENCH_I2C_ADDRESS 0x50
+
+// The interrupt handlers are called directly. They end with reti, which
+// enables the interrupts.
+void TIMER0_COMPA_vect(void);
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+
+typedef struct
+{
+    ring_t in;
+    ring_t out;
+    ring_t ring;
+    uint8_t inData[16];
+    uint8_t outData[16];
+    uint8_t ringData[16];
+    uint16_t overhead;
+    char line[40];
+    volatile uint8_t sending;
+} bench_t;
+static bench_t self;
+
+static const uint8_t bench_newline[] = "\n";
+
+static inline __attribute__((always_inline)) void bench_start(void)
+{
+    TCNT1 = 0;
+    TIFR1 = (1 << TOV1);
+    __asm__ __volatile__ ("" ::: "memory");
+}
+
+static inline __attribute__((always_inline)) uint16_t bench_stop(void)
+{
+    uint16_t cycles;
+
+    __asm__ __volatile__ ("" ::: "memory");
+    cycles = TCNT1;
+    if (TIFR1 & (1 << TOV1))
+    {
+        return BENCH_OVERFLOW;
+    }
+    return cycles;
+}
+
+/*
+ * Measure code. The setup and teardown are run before and after each run
+ * and are not measured.
+ */
+#define BENCH_MEASURE(result, setup, code, teardown)    \
+    do                                                  \
+    {                                                   \
+        uint8_t run_;                                   \
+        uint16_t cycles_;                               \
+        (result) = BENCH_OVERFLOW;                      \
+        for (run_ = 0; run_ < BENCH_RUNS; ++run_)       \
+        {                                               \
+            setup;                                      \
+            bench_start();                              \
+            code;                                       \
+            cycles_ = bench_stop();                     \
+            teardown;                                   \
+            if (cycles_ < (result))                     \
+            {                                           \
+                (result) = cycles_;                     \
+            }                                           \
+        }                                               \
+    } while (0)
+
+#define BENCH(name, setup, code, teardown)                      \
+    do                                                          \
+    {                                                           \
+        uint16_t cycles;                                        \
+        BENCH_MEASURE(cycles, setup, code, teardown);           \
+        bench_report(name, bench_cycles(cycles));               \
+    } while (0)
+
+static void bench_sent(void)
+{
+    self.sending = 0;
+}
+
+static uint16_t bench_cycles(uint16_t cycles)
+{
+    if (cycles == BENCH_OVERFLOW)
+    {
+        return cycles;
+    }
+    return cycles > self.overhead ? cycles - self.overhead : 0;
+}
+
+static void bench_report(const char *name, uint16_t cycles)
+{
+    char *pos = self.line;
+
+    memcpy(pos, "BENCH,", 6);
+    pos += 6;
+    strcpy(pos, name);
+    pos += strlen(pos);
+    *pos++ = ',';
+    utoa(cycles, pos, 10);
+    pos += strlen(pos);
+    *pos++ = '\r';
+    *pos++ = '\n';
+
+    // The line is sent and the data register empty interrupt is disabled
+    // again before the next measurement
+    sei();
+    self.sending = 1;
+    while (uart_hal_send_buffer((const uint8_t *) self.line,
+                                (uint8_t)(pos - self.line),
+                                bench_sent) == uart_hal_busy);
+    while (self.sending);
+    while (UCSR0B & (1 << UDRIE0));
+}
+
+int main(void)
+{
+    volatile Tick_t ticks;
+    volatile uint32_t now;
+    volatile uint8_t byte;
+
+    ring_init(&self.in, self.inData, sizeof(self.inData));
+    ring_init(&self.out, self.outData, sizeof(self.outData));
+    ring_init(&self.ring, self.ringData, sizeof(self.ringData));
+
+    timer_init();
+    uart_hal_init_ring(&self.in, &self.out);
+    i2c_init();
+    pin_digital_io_set_mode(BENCH_PIN, pin_digital_io_output);
+
+    // Timer 1 in normal mode at clk/1
+    TCCR1A = 0;
+    TCCR1B = (1 << CS10);
+
+    timer_start();
+
+    BENCH_MEASURE(self.overhead, , , );
+    bench_report("overhead", self.overhead);
+
+    BENCH("pin_write_high", , pin_digital_io_write_high(BENCH_PIN), );
+    BENCH("pin_write_low", , pin_digital_io_write_low(BENCH_PIN), );
+    BENCH("pin_fast_high", , pin_digital_io_fast_high(BENCH_PIN), );
+    BENCH("pin_toggle", , pin_digital_io_toggle(BENCH_PIN), );
+
+    BENCH("tick_read", , ticks = timer_get_ticks(), );
+    BENCH("now_us", , now = timer_now_us(), );
+
+    BENCH("ring_put", , ring_put(&self.ring, 0x55), );
+    BENCH("ring_get", , byte = ring_get(&self.ring), );
+
+    BENCH("isr_timer0", cli(), TIMER0_COMPA_vect(), );
+    BENCH("isr_uart_rx", cli(), USART_RX_vect(),
+          if (!ring_is_empty(&self.in)) ring_get(&self.in));
+    BENCH("isr_uart_udre_ring",
+          cli(); ring_put(&self.out, '\n'),
+          USART_UDRE_vect(), );
+    // The data register empty interrupt is disabled so that it isn't
+    // served at the reti of the handler
+    BENCH("isr_uart_udre_buffer",
+          cli(); uart_hal_send_buffer(bench_newline, 1, 0);
+          UCSR0B &= ~(1 << UDRIE0),
+          USART_UDRE_vect(), );
+
+    // A NACK is expected if no device is connected, which takes as long on
+    // the bus as an ACK
+    BENCH("i2c_write_byte", i2c_start(),
+          i2c_write_byte((uint8_t)(BENCH_I2C_ADDRESS << 1)), i2c_stop());
+
+    (void) ticks;
+    (void) now;
+    (void) byte;
+
+    // Wait for the last byte to be sent and stop. A simulator exits when
+    // the MCU sleeps with the interrupts disabled.
+    while (!(UCSR0A & (1 << UDRE0)));
+    cli();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    sleep_cpu();
+    return 0;
+}
@@ -0,0 +1,19 @@
+/*
+ * Port configuration of the benchmark.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef BENCH_PORT_CONFIG_H
+#define BENCH_PORT_CONFIG_H
+
+#include <avr/io.h>
+
+#define LED_PORT PORTB
+#define LED_DDR DDRB
+
+#endif // BENCH_PORT_CONFIG_H
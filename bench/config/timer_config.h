@@ -0,0 +1,19 @@
+/*
+ * Timer configuration of the benchmark.
+ *
+ * Copyright (c) 2020. BlueZephyr
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.  See the LICENSE file for details.
+ *
+ */
+
+#ifndef BENCH_TIMER_CONFIG_H
+#define BENCH_TIMER_CONFIG_H
+
+#include <stdint.h>
+
+// 32-bit ticks, the worst case for the tick interrupt and the tick reads
+typedef uint32_t Tick_t;
+
+#endif // BENCH_TIMER_CONFIG_H
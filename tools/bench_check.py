@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+#
+# Compare the results of the benchmark with a baseline.
+#
+# Copyright (c) 2020. BlueZephyr
+#
+# This software may be modified and distributed under the terms
+# of the MIT license.  See the LICENSE file for details.
+#
+"""Compare benchmark results with a baseline.
+
+The results are the BENCH,<name>,<cycles> lines written by the benchmark,
+mixed with any other output (e.g. from the simulator). The baseline is a CSV
+file with name,cycles rows. A benchmark fails if it takes more than the
+tolerance (in percent) longer than in the baseline, or if it is missing.
+
+Use --update to write the results as the new baseline.
+"""
+
+import argparse
+import csv
+import re
+import sys
+
+BENCH_LINE = re.compile(r'BENCH,([A-Za-z0-9_]+),(\d+)')
+
+
+def read_results(path):
+    results = {}
+    with open(path, errors='replace') as f:
+        for line in f:
+            match = BENCH_LINE.search(line)
+            if match:
+                results[match.group(1)] = int(match.group(2))
+    return results
+
+
+def read_baseline(path):
+    baseline = {}
+    with open(path, newline='') as f:
+        for row in csv.reader(f):
+            if len(row) != 2 or row[0].startswith('#'):
+                continue
+            baseline[row[0]] = int(row[1])
+    return baseline
+
+
+def write_baseline(path, results):
+    with open(path, 'w', newline='') as f:
+        writer = csv.writer(f, lineterminator='\n')
+        for name, cycles in results.items():
+            writer.writerow([name, cycles])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('results', help='benchmark output')
+    parser.add_argument('baseline', help='baseline CSV file')
+    parser.add_argument('--tolerance', type=float, default=5.0,
+                        help='allowed slowdown in percent (default 5)')
+    parser.add_argument('--update', action='store_true',
+                        help='write the results as the new baseline')
+    args = parser.parse_args()
+
+    results = read_results(args.results)
+    if not results:
+        print('No BENCH lines found in %s' % args.results)
+        return 1
+
+    if args.update:
+        write_baseline(args.baseline, results)
+        print('Wrote %d results to %s' % (len(results), args.baseline))
+        return 0
+
+    try:
+        baseline = read_baseline(args.baseline)
+    except FileNotFoundError:
+        print('No baseline %s, create it with --update' % args.baseline)
+        return 1
+
+    failed = 0
+    for name, base in baseline.items():
+        if name not in results:
+            print('%-24s %8d %8s  MISSING' % (name, base, '-'))
+            failed += 1
+            continue
+        cycles = results[name]
+        limit = base * (1.0 + args.tolerance / 100.0)
+        change = (cycles - base) * 100.0 / base if base else 0.0
+        status = 'FAIL' if cycles > limit else 'ok'
+        if cycles > limit:
+            failed += 1
+        print('%-24s %8d %8d %+7.1f%%  %s' % (name, base, cycles, change, status))
+
+    for name in results:
+        if name not in baseline:
+            print('%-24s %8s %8d  NEW' % (name, '-', results[name]))
+
+    if failed:
+        print('%d benchmark(s) failed with a tolerance of %g%%'
+              % (failed, args.tolerance))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
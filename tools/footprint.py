@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+#
+# Flash and RAM footprint report from a GNU ld map file.
+#
+# Copyright (c) 2020. BlueZephyr
+#
+# This software may be modified and distributed under the terms
+# of the MIT license.  See the LICENSE file for details.
+#
+"""Report the .text/.data/.bss bytes per module and per symbol.
+
+The input sections in the memory map of the linker map file are attributed
+to modules by the file they come from: the HAL libraries (libtimer.a etc.)
+give the module name, the object files of the application are reported as
+"app" and the toolchain libraries as libc, libgcc etc. The symbol is taken
+from the input section name, which is one section per function and variable
+with -ffunction-sections and -fdata-sections.
+
+.text is flash, .bss is RAM and .data is both. With --baseline the result is
+compared with a JSON file written earlier with --update.
+"""
+
+import argparse
+import json
+import os
+import re
+import sys
+
+CATEGORIES = ('text', 'data', 'bss')
+
+# Output section -> category
+OUTPUT_SECTIONS = {
+    '.text': 'text',
+    '.data': 'data',
+    '.bss': 'bss',
+    '.noinit': 'bss',
+}
+
+SECTION_PREFIXES = (
+    '.progmem.data.', '.progmem.gcc_sw_table.', '.text.', '.rodata.',
+    '.data.', '.bss.', '.noinit.',
+)
+
+TOOLCHAIN_LIBRARIES = ('c', 'gcc', 'm', 'printf_flt', 'printf_min',
+                       'scanf_flt', 'scanf_min')
+
+OUTPUT_SECTION = re.compile(r'^(\.\S+)')
+INPUT_NAME = re.compile(r'^ (\S+)\s*$')
+INPUT_SECTION = re.compile(
+    r'^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(\S.*)$')
+ARCHIVE_MEMBER = re.compile(r'lib([^/\\]+)\.a\(([^)]+)\)$')
+
+
+def module_of(path):
+    match = ARCHIVE_MEMBER.search(path)
+    if match:
+        name = match.group(1)
+        if name in TOOLCHAIN_LIBRARIES or name.startswith(('at', 'avr')):
+            return 'lib' + name
+        return name
+    base = os.path.basename(path)
+    if base.startswith('crt'):
+        return 'crt'
+    return 'app'
+
+
+def symbol_of(section, path):
+    for prefix in SECTION_PREFIXES:
+        if section.startswith(prefix):
+            return section[len(prefix):]
+    # A section that isn't split per symbol, e.g. .vectors or assembler code
+    match = ARCHIVE_MEMBER.search(path)
+    member = match.group(2) if match else os.path.basename(path)
+    return '%s(%s)' % (section, member)
+
+
+def parse_map(path):
+    modules = {}
+    symbols = {}
+    in_map = False
+    category = None
+    pending = None
+
+    with open(path, errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if not in_map:
+                in_map = line.startswith('Linker script and memory map')
+                continue
+
+            match = OUTPUT_SECTION.match(line)
+            if match:
+                category = OUTPUT_SECTIONS.get(match.group(1))
+                pending = None
+                continue
+            if line and not line[0].isspace():
+                category = None
+                continue
+            if category is None:
+                continue
+
+            # Long input section names are on a line of their own
+            match = INPUT_NAME.match(line)
+            if match and not match.group(1).startswith('*'):
+                pending = match.group(1)
+                continue
+
+            match = INPUT_SECTION.match(line)
+            if not match:
+                continue
+            section = match.group(1) or pending
+            pending = None
+            size = int(match.group(3), 16)
+            if not section or section.startswith('*') or size == 0:
+                continue
+
+            source = match.group(4).strip()
+            module = module_of(source)
+            symbol = '%s:%s' % (module, symbol_of(section, source))
+
+            modules.setdefault(module, dict.fromkeys(CATEGORIES, 0))
+            modules[module][category] += size
+            symbols.setdefault(symbol, dict.fromkeys(CATEGORIES, 0))
+            symbols[symbol][category] += size
+
+    return {'modules': modules, 'symbols': symbols}
+
+
+def delta(value, base):
+    if base is None:
+        return ''
+    diff = value - base
+    return '%+d' % diff if diff else ''
+
+
+def print_table(title, rows, baseline, limit=None):
+    print('%-40s %7s %7s %7s' % ((title,) + CATEGORIES))
+    names = sorted(rows, key=lambda n: (-sum(rows[n].values()), n))
+    if limit is not None:
+        names = names[:limit]
+    for name in names:
+        sizes = rows[name]
+        base = baseline.get(name) if baseline is not None else None
+        columns = []
+        for category in CATEGORIES:
+            columns.append('%7d' % sizes[category])
+        line = '%-40s %s' % (name, ' '.join(columns))
+        if baseline is not None:
+            if base is None:
+                line += '  new'
+            else:
+                diffs = [delta(sizes[c], base.get(c, 0)) for c in CATEGORIES]
+                if any(diffs):
+                    line += '  (%s)' % '/'.join(d or '0' for d in diffs)
+        print(line)
+    if baseline is not None:
+        for name in sorted(set(baseline) - set(rows)):
+            print('%-40s %7s %7s %7s  removed' % (name, '-', '-', '-'))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('map', help='linker map file')
+    parser.add_argument('--baseline', help='JSON baseline to compare with')
+    parser.add_argument('--update', action='store_true',
+                        help='write the result to the baseline file')
+    parser.add_argument('--symbols', type=int, default=20,
+                        help='number of symbols to list (default 20, '
+                             '0 for all)')
+    args = parser.parse_args()
+
+    result = parse_map(args.map)
+    if not result['modules']:
+        print('No sections found in %s' % args.map)
+        return 1
+
+    if args.update:
+        if not args.baseline:
+            parser.error('--update needs --baseline')
+        with open(args.baseline, 'w') as f:
+            json.dump(result, f, indent=2, sort_keys=True)
+            f.write('\n')
+        print('Wrote %s' % args.baseline)
+        return 0
+
+    baseline = None
+    if args.baseline:
+        try:
+            with open(args.baseline) as f:
+                baseline = json.load(f)
+        except FileNotFoundError:
+            print('No baseline %s, create it with --update' % args.baseline)
+
+    totals = dict.fromkeys(CATEGORIES, 0)
+    for sizes in result['modules'].values():
+        for category in CATEGORIES:
+            totals[category] += sizes[category]
+
+    print_table('Module', result['modules'],
+                baseline['modules'] if baseline else None)
+    print('%-40s %7d %7d %7d' % (('Total',) + tuple(totals[c] for c in CATEGORIES)))
+    print('Flash: %d bytes, RAM: %d bytes (without stack)'
+          % (totals['text'] + totals['data'], totals['data'] + totals['bss']))
+    print()
+    print_table('Symbol', result['symbols'],
+                baseline['symbols'] if baseline else None,
+                args.symbols or None)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
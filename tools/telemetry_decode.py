@@ -0,0 +1,134 @@
+#!/usr/bin/env python3
+#
+# Decoder of the telemetry frames.
+#
+# Copyright (c) 2020. BlueZephyr
+#
+# This software may be modified and distributed under the terms
+# of the MIT license.  See the LICENSE file for details.
+#
+"""Decode the telemetry frames written by the telemetry module.
+
+The frames are COBS encoded and terminated by a zero byte (see
+avr_hal/telemetry.h). Each record is written as one CSV line:
+
+    <tick>,<seconds>,<type>,<data as hex>
+
+Frames with an invalid CRC or length are reported on stderr and skipped.
+The input is a file (or - for stdin) with the raw UART data, or a serial
+port with --port, which needs pyserial.
+"""
+
+import argparse
+import struct
+import sys
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise ValueError('invalid COBS code')
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xff and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def crc16_xmodem(data):
+    crc = 0
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xffff
+            else:
+                crc = (crc << 1) & 0xffff
+    return crc
+
+
+def parse_frame(frame):
+    """Returns a list of (tick, type, data) tuples."""
+    if len(frame) < 6:
+        raise ValueError('frame too short')
+    body, crc = frame[:-2], (frame[-2] << 8) | frame[-1]
+    if crc16_xmodem(body) != crc:
+        raise ValueError('CRC mismatch')
+
+    (tick,) = struct.unpack_from('<I', body, 0)
+    records = []
+    pos = 4
+    while pos < len(body):
+        if pos + 4 > len(body):
+            raise ValueError('truncated record header')
+        kind, length, delta = struct.unpack_from('<BBH', body, pos)
+        pos += 4
+        if pos + length > len(body):
+            raise ValueError('truncated record data')
+        records.append(((tick + delta) & 0xffffffff, kind, body[pos:pos + length]))
+        pos += length
+    return records
+
+
+def frames(stream):
+    buffer = bytearray()
+    while True:
+        chunk = stream.read(1)
+        if not chunk:
+            return
+        if chunk[0] == 0:
+            if buffer:
+                yield bytes(buffer)
+            buffer = bytearray()
+        else:
+            buffer += chunk
+
+
+def open_input(args):
+    if args.port:
+        try:
+            import serial
+        except ImportError:
+            sys.exit('pyserial is needed to read from a serial port')
+        return serial.Serial(args.port, args.baud)
+    if args.input == '-':
+        return sys.stdin.buffer
+    return open(args.input, 'rb')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('input', nargs='?', default='-',
+                        help='file with the UART data (default stdin)')
+    parser.add_argument('--port', help='serial port to read from')
+    parser.add_argument('--baud', type=int, default=9600,
+                        help='baud rate of the serial port (default 9600)')
+    parser.add_argument('--tick-us', type=int, default=1000,
+                        help='tick period in microseconds (default 1000)')
+    args = parser.parse_args()
+
+    stream = open_input(args)
+    errors = 0
+    try:
+        for encoded in frames(stream):
+            try:
+                records = parse_frame(cobs_decode(encoded))
+            except ValueError as error:
+                errors += 1
+                print('Invalid frame (%s): %s' % (error, encoded.hex()),
+                      file=sys.stderr)
+                continue
+            for tick, kind, data in records:
+                print('%d,%.6f,%d,%s' % (tick, tick * args.tick_us / 1e6,
+                                         kind, data.hex()))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    return 1 if errors else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())